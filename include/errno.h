@@ -0,0 +1,8 @@
+#ifndef ERRNO_H
+#define ERRNO_H
+
+/* 错误码（取 Linux 的数值），系统调用以负值返回；其余接口仍用 -1 表示失败 */
+#define EFAULT        14   /* 地址未映射或没有相应权限 */
+#define ENAMETOOLONG  36   /* 路径名超过 FS_NAME_LEN */
+
+#endif
@@ -20,12 +20,19 @@ int  fs_create(const char *name);
 int  fs_write(int fid, const void *buf, int len);
 int  fs_read(int fid, void *buf, int len);
 int  fs_unlink(const char *name);
+int  fs_read_at(int fid, uint64_t off, void *buf, int len);
 
 /* 文件描述符接口 */
 int  fs_open(const char *name, int flags);
 int  fs_close(int fd);
 int  fs_read_fd(int fd, void *buf, int len);
 int  fs_write_fd(int fd, const void *buf, int len);
+int  fs_fd_file(int fd);
+
+/* 文件引用（供文件映射使用）：持有期间文件即使被删除也不会释放 */
+int  fs_file_get(int fd);      /* 取 fd 对应的文件索引并加引用，失败返回 -1 */
+void fs_file_dup(int fid);
+void fs_file_put(int fid);
 
 /* 调试/信息打印 */
 void fs_print_info(void);
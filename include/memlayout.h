@@ -5,6 +5,20 @@
 #define KERNBASE 0x80000000L          // 内核起始虚拟地址
 #define PHYSTOP  (KERNBASE + 128*1024*1024) // 物理内存顶部 (128MB)
 
+/* 进程私有地址空间：Sv39 根页表第 1 项覆盖的 1GB。
+   内核映射位于第 0 项（设备）和第 2 项（RAM），进程页表直接共享其下级页表 */
+#define USERBASE 0x40000000L
+#define USERTOP  0x80000000L
+
+/* 用户区布局：堆从 USERBASE 向上，文件映射从 USERMMAP 向上，栈位于顶部 */
+#define USERMMAP      0x60000000L
+#define USTACK_SIZE   (1024 * 1024)
+#define USTACK_BOTTOM (USERTOP - USTACK_SIZE)
+
+/* 支持的最大 hart 数：mhartid 更大的 hart 启动后停在 _start；每个 hart 一个启动栈 */
+#define NCPU            8
+#define BOOT_STACK_SIZE 4096
+
 /* 设备地址 */
 #define UART0    0x10000000L
 
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+/* 伙伴系统最大阶：最大连续块为 2^PMM_MAX_ORDER 页（4MB） */
+#define PMM_MAX_ORDER 10
+
 /* 初始化物理内存管理器 */
 void pmm_init(void);
 
@@ -12,4 +15,45 @@ void* alloc_page(void);
 /* 释放一个物理页 */
 void free_page(void* pa);
 
-#endif
\ No newline at end of file
+/* 分配一个不清零的物理页（调用者会覆盖整页内容） */
+void* alloc_page_nozero(void);
+
+/* 空闲时补充预清零页池 */
+void pmm_refill_zero_pool(void);
+
+/* 分配/释放 2^order 个物理连续的页，pa 按块大小对齐 */
+void* alloc_pages(int order);
+void* alloc_pages_nozero(int order);
+void free_pages(void* pa, int order);
+
+/* 物理页引用计数：free_page() 仅在计数降为 0 时真正释放 */
+void pmm_incref(void* pa);
+int  pmm_refcount(void* pa);
+
+/* 打印各阶空闲块统计 */
+void pmm_dump(void);
+
+/* 分配者子系统标签：新分配的页默认记为 PMM_TAG_OTHER，调用者用 pmm_set_tag 归类 */
+#define PMM_TAG_OTHER  0
+#define PMM_TAG_KSTACK 1   /* 进程内核栈 */
+#define PMM_TAG_PGTBL  2   /* 页表页 */
+#define PMM_TAG_SLAB   3   /* slab/kmalloc（含文件数据） */
+#define PMM_TAG_USER   4   /* 进程用户页 */
+#define PMM_TAG_FS     5   /* 文件数据（整页缓冲区；小缓冲区计入 slab） */
+#define PMM_NTAGS      6
+
+/* 内存统计（单位：页），也是 SYS_meminfo 返回给用户的布局 */
+struct pmm_stats {
+    uint64_t total;
+    uint64_t free;
+    uint64_t used;
+    uint64_t peak;       /* used 的历史最大值 */
+    uint64_t failures;   /* 分配失败次数 */
+    uint64_t by_tag[PMM_NTAGS];
+};
+
+void pmm_set_tag(void* pa, int tag);
+void pmm_get_stats(struct pmm_stats *st);
+void meminfo_dump(void);
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include "riscv.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "vmm.h"
 
 /* 保证有 uint64 类型（避免重复定义冲突） */
 #ifndef PROC_UINT64_DEFINED
@@ -13,6 +16,34 @@ typedef unsigned long long uint64;
 /* 最大进程数 */
 #define NPROC 16
 
+/* nice 值范围与 nice 0 对应的权重：权重越大，虚拟运行时间增长越慢，分到的 CPU 越多 */
+#define NICE_MIN      (-20)
+#define NICE_MAX      19
+#define NICE_0_WEIGHT 1024
+
+/* pid 散列桶数（2 的幂），按 pid 查找进程不必扫描 proc[] */
+#define NPIDHASH 64
+
+/* 等待队列散列桶数（2 的幂）：按 chan 地址散列，wakeup 只看同一桶里的睡眠者 */
+#define NWAITHASH 64
+
+/* 内核栈页数（2 的幂），可用 make KSTACK=n 配置。
+   定时器抢占不经 p->tf：mti_entry 在进程内核栈上压 144 字节的帧，再经
+   timer_trap → timer_interrupt → proc_tick → preempt → sched 切走，这些帧在进程让出期间
+   一直留在栈上。栈大小要在最深的系统调用路径之外为它留出余量（kstack_dump 的水位已包含这部分） */
+#ifndef KSTACK_PAGES
+#define KSTACK_PAGES 2
+#endif
+#define KSTACK_SIZE  (KSTACK_PAGES * PGSIZE)
+
+/* 时间片长度（时钟节拍数），可用 make QUANTUM=n 配置 */
+#ifndef SCHED_QUANTUM
+#define SCHED_QUANTUM 1
+#endif
+
+/* waitpid 选项：没有已退出的子进程时立即返回 0 */
+#define WNOHANG 1
+
 /* 进程状态 */
 enum procstate { UNUSED, USED, RUNNABLE, RUNNING, SLEEPING, ZOMBIE };
 
@@ -34,36 +65,114 @@ struct context {
     uint64 s11;
 };
 
+/* 陷阱帧：kernelvec.S 的完整保存路径（异常等）按此布局保存被中断的寄存器（偏移固定，修改需同步汇编） */
+struct trapframe {
+    /*   0 */ uint64 ra, gp, tp, t0, t1, t2, s0, s1;
+    /*  64 */ uint64 a0, a1, a2, a3, a4, a5, a6, a7;
+    /* 128 */ uint64 s2, s3, s4, s5, s6, s7, s8, s9, s10, s11;
+    /* 208 */ uint64 t3, t4, t5, t6;
+    /* 240 */ uint64 mcause;
+    /* 248 */ uint64 mepc;
+    /* 256 */ uint64 sp;
+    /* 264 */ uint64 mstatus;
+    /* 272 */ uint64 on_stack;   /* 1：保存在栈上（没有可用的进程 trapframe） */
+    /* 280 */ uint64 pad;
+};
+
 /* 进程结构（简化）*/
 struct proc {
+    int slot;                 /* 在 proc[] 槽位表中的下标 */
     int pid;
     enum procstate state;
-    void *kstack;             /* kernel stack bottom */
+    void *kstack;             /* kernel stack bottom，共 KSTACK_SIZE 字节 */
+    uint32_t kstack_used;     /* 内核栈最高水位（字节），退出时扫描金丝雀得到 */
+    pagetable_t pagetable;    /* 进程私有页表（共享内核映射） */
+    uint64 asid;              /* 地址空间标识，写入 satp */
+    uint64 asid_gen;          /* asid 所属代数，过期则切换时重新分配 */
+    uint64 sz;                /* 堆大小：[USERBASE, USERBASE+sz) */
+    struct vma vma[NVMA];     /* 地址空间区域：堆、栈、文件映射 */
+    uint64 mmap_top;          /* 下一次文件映射的起始地址 */
+    int nfault_anon;          /* 缺页计数：匿名页（堆/栈）按需分配 */
+    int nfault_file;          /* 缺页计数：文件映射页装入 */
+    int nfault_cow;           /* 缺页计数：写时复制 */
+    int nfault_swap;          /* 缺页计数：从 zram 换入 */
     struct context context;   /* 上下文，用于 swtch */
+    struct trapframe tf;      /* 进程被完整保存路径（异常等）打断时的寄存器；定时器抢占只在内核栈上保存，不经这里 */
+    struct spinlock vmlock;   /* 保护页表和 VMA（缺页、sbrk、fork 与换出扫描互斥） */
+    int slice;                /* 本次运行已用的时钟节拍 */
+    int preempt_count;        /* >0 时禁止抢占 */
+    int need_resched;         /* 禁止抢占期间时间片已用完，恢复时让出 */
+    int nvcsw;                /* 主动切换次数（yield/sleep/exit） */
+    int nivcsw;               /* 被抢占次数 */
     void (*entry)(void);      /* 进程入口函数（内核线程） */
     void *chan;               /* 等待通道，用于 sleep/wakeup */
+    struct proc *wq_next;     /* 等待队列链接（仅 SLEEPING 时在队列中） */
+    struct proc *wq_prev;
     int killed;
     int xstate;               /* exit status */
     int parent;               /* 父进程pid，用于fork/wait */
-    int fork_ret;             /* fork返回值：-1表示未fork，>=0表示fork返回值 */
+    struct proc *parent_proc; /* 父进程，0 表示无父进程（退出后由调度器直接回收） */
+    struct proc *children;    /* 子进程链表（含尚未被 wait 回收的僵尸） */
+    struct proc *sibling_next;
+    struct proc *sibling_prev;
+    int nice;                 /* 调度优先级 NICE_MIN..NICE_MAX，fork 时继承 */
+    uint32_t weight;          /* 由 nice 查表得到的权重 */
+    uint64 vruntime;          /* 虚拟运行时间：实际运行的 mtime 计数 * NICE_0_WEIGHT / weight */
+    uint64 exec_start;        /* 本次被调度运行时的 mtime */
+    int rq_index;             /* 在就绪堆中的下标，不在堆中为 -1 */
+    struct proc *pid_next;    /* pid 散列链 */
+    struct ring *ring;        /* 提交/完成环（SYS_ring_setup 建立），fork 不继承 */
 };
 
-extern struct proc proc[NPROC];
+/* 每个 hart 的调度状态，按 mhartid 索引 */
+struct cpu {
+    struct proc *proc;        /* 当前运行的进程，没有则为 0 */
+    struct context context;   /* 调度器上下文，swtch 到这里回到 scheduler() */
+    int noff;                 /* push_off 嵌套深度 */
+    int intena;               /* 第一次 push_off 之前是否开中断 */
+    int idle;                 /* 调度器无事可做、正在 wfi（受 proc_lock 保护），入队时向其发 IPI */
+};
+
+extern struct cpu cpus[NCPU];
+extern struct proc *proc[NPROC];
+extern struct spinlock proc_lock;   /* 保护 proc[] 与各进程的 state/chan/父子链表 */
 
 /* swtch 汇编函数原型 */
 extern void swtch(struct context *old, struct context *new);
+/* 保存当前上下文：直接调用返回 0，被 swtch 切换回来时返回非 0（见 swtch.S） */
+extern long savecontext(struct context *c) __attribute__((returns_twice));
 
 /* API */
+void proc_init(void);
 void scheduler(void);
 int create_process(void (*entry)(void));
 void exit_process(int status) __attribute__((noreturn));
 int wait_process(int *status);
+int waitpid(int pid, int *status, int options);   /* pid 为 -1 等待任意子进程；status 只能是内核地址（系统调用由 sys_waitpid 拷出） */
 struct proc* allocproc(void);  /* 分配进程结构（供fork使用） */
+void freeproc(struct proc *p); /* 释放进程结构（供fork失败回滚使用） */
 
 /* 进程内部调用 */
+int cpuid(void);
+struct cpu* mycpu(void);
 struct proc* myproc(void);
 void yield(void);
+void proc_tick(void);          /* 时钟中断调用：时间片用完时抢占当前进程 */
+void preempt_disable(void);
+void preempt_enable(void);
 void sleep(void *chan);
 void wakeup(void *chan);
+void wakeup_one(void *chan);   /* 只唤醒在 chan 上等待最久的一个进程 */
+int sleep_until(uint64 when);  /* 睡到 mtime 达到 when，被杀死时提前返回 -1 */
+void wait_dump(void);          /* 打印各等待队列的统计 */
+void kstack_dump(void);        /* 打印内核栈缓存与最高水位统计 */
+
+/* 以下需持有 proc_lock */
+void proc_setrunnable(struct proc *p);   /* 置为 RUNNABLE 并加入就绪队列 */
+struct proc* proc_find(int pid);         /* 按 pid 查找，不存在返回 0 */
+void proc_add_child(struct proc *parent, struct proc *child);
+
+/* 设置进程 nice 值（pid 为 0 表示当前进程），成功返回 0 */
+int proc_setnice(int pid, int nice);
 
 #endif
\ No newline at end of file
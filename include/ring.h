@@ -0,0 +1,57 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+/* 提交/完成环：进程把多个 I/O 请求写进提交队列（SQ），一次 SYS_ring_enter 全部执行，
+   结果写进完成队列（CQ）。两个队列与头部在同一个共享页中，生产者只推进 tail，消费者只推进 head */
+
+#define RING_ENTRIES 32   /* 每个队列的项数（2 的幂） */
+
+/* 操作码 */
+#define RING_OP_NOP   0
+#define RING_OP_READ  1   /* fs_read_fd(fd, addr, len) */
+#define RING_OP_WRITE 2   /* fs_write_fd(fd, addr, len) */
+#define RING_OP_OPEN  3   /* fs_open((char*)addr, op_flags)，结果为新 fd */
+#define RING_OP_CLOSE 4   /* fs_close(fd) */
+
+/* 提交项：进程填写 */
+struct ring_sqe {
+    uint8_t opcode;
+    uint8_t pad[3];
+    int32_t fd;
+    uint64_t addr;            /* 缓冲区或路径名 */
+    uint32_t len;
+    uint32_t op_flags;        /* OPEN 的 O_* 标志 */
+    uint64_t user_data;       /* 原样带回完成项，用于对应请求 */
+};
+
+/* 完成项：内核填写 */
+struct ring_cqe {
+    uint64_t user_data;
+    int64_t res;              /* 与对应系统调用的返回值相同。失败为负值：缓冲区或路径名非法为 -EFAULT，
+                                 路径名过长为 -ENAMETOOLONG，其余（坏 fd、未知操作码等）为 -1 */
+};
+
+struct ring {
+    volatile uint32_t sq_head;   /* 内核消费到的位置 */
+    volatile uint32_t sq_tail;   /* 进程提交到的位置 */
+    volatile uint32_t cq_head;   /* 进程消费到的位置 */
+    volatile uint32_t cq_tail;   /* 内核完成到的位置 */
+    uint32_t entries;            /* RING_ENTRIES，供进程读取 */
+    uint32_t nenter;             /* SYS_ring_enter 次数 */
+    uint64_t nops;               /* 已完成的操作数 */
+    struct ring_sqe sq[RING_ENTRIES];
+    struct ring_cqe cq[RING_ENTRIES];
+};
+
+struct proc;
+
+/* 为进程建立环（已有则返回原来的），返回共享页地址，失败返回 0 */
+struct ring *ring_setup(struct proc *p);
+/* 执行至多 to_submit 个已提交的请求（提交队列已空或完成队列满时提前停止），返回实际执行的个数。
+   操作都是同步完成的，返回时每个执行过的请求都已有完成项，不需要也不提供等待完成的参数 */
+long ring_enter(struct proc *p, uint32_t to_submit);
+void ring_free(struct proc *p);
+
+#endif
@@ -19,6 +19,15 @@
 #define PTE_W (1L << 2) // 可写
 #define PTE_X (1L << 3) // 可执行
 #define PTE_U (1L << 4) // 用户态可访问
+#define PTE_A (1L << 6) // 已访问
+#define PTE_D (1L << 7) // 已写（脏）
+#define PTE_COW (1L << 8) // RSW 软件位：写时复制共享页
+
+/* 叶子PTE：R/W/X 任一置位；否则指向下一级页表 */
+#define PTE_LEAF(pte) ((pte) & (PTE_R | PTE_W | PTE_X))
+
+/* 第 level 级叶子映射的大小：0 级 4KB，1 级 2MB，2 级 1GB */
+#define LEVEL_SIZE(level) (1UL << (PGSHIFT + 9 * (level)))
 
 /* 将PTE转换为物理地址 */
 #define PTE2PA(pte) (((pte) >> 10) << 12)
@@ -33,6 +42,16 @@
 typedef uint64_t pte_t;
 typedef uint64_t* pagetable_t;
 
+/* satp：Sv39 模式 + 根页表物理页号 */
+#define SATP_SV39 (8L << 60)
+#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64_t)(pagetable)) >> 12))
+
+/* satp ASID 字段（Sv39 下位于 [59:44]，实现可能只支持其中低若干位） */
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK  0xFFFFULL
+#define MAKE_SATP_ASID(pagetable, asid) \
+    (MAKE_SATP(pagetable) | (((uint64_t)(asid) & SATP_ASID_MASK) << SATP_ASID_SHIFT))
+
 /* 读写SATP寄存器 (Supervisor Address Translation and Protection) */
 static inline void w_satp(uint64_t x) {
     asm volatile("csrw satp, %0" : : "r" (x));
@@ -49,6 +68,21 @@ static inline void sfence_vma(void) {
     asm volatile("sfence.vma zero, zero");
 }
 
+/* 只刷新某个虚拟地址在所有地址空间中的 TLB 项 */
+static inline void sfence_vma_va(uint64_t va) {
+    asm volatile("sfence.vma %0, zero" : : "r"(va) : "memory");
+}
+
+/* 只刷新某个 ASID 的全部 TLB 项（不影响全局映射） */
+static inline void sfence_vma_asid(uint64_t asid) {
+    asm volatile("sfence.vma zero, %0" : : "r"(asid) : "memory");
+}
+
+/* 只刷新某个 ASID 下某个虚拟地址的 TLB 项 */
+static inline void sfence_vma_va_asid(uint64_t va, uint64_t asid) {
+    asm volatile("sfence.vma %0, %1" : : "r"(va), "r"(asid) : "memory");
+}
+
 /* ====== 新增：CSR/中断/定时器/CLINT 工具 ====== */
 
 /* CSR 访问 */
@@ -64,6 +98,9 @@ static inline uint64_t r_mepc(void){ uint64_t x; asm volatile("csrr %0, mepc":"=
 static inline void     w_mepc(uint64_t x){ asm volatile("csrw mepc, %0"::"r"(x)); }
 static inline uint64_t r_mtval(void){ uint64_t x; asm volatile("csrr %0, mtval":"=r"(x)); return x; }
 static inline uint64_t r_mhartid(void){ uint64_t x; asm volatile("csrr %0, mhartid":"=r"(x)); return x; }
+static inline uint64_t r_mcycle(void){ uint64_t x; asm volatile("csrr %0, mcycle":"=r"(x)); return x; }
+static inline uint64_t r_mscratch(void){ uint64_t x; asm volatile("csrr %0, mscratch":"=r"(x)); return x; }
+static inline void     w_mscratch(uint64_t x){ asm volatile("csrw mscratch, %0"::"r"(x)); }
 
 /* 置/清 mstatus/mie 位 */
 static inline void set_mstatus(uint64_t mask){ w_mstatus(r_mstatus() | mask); }
@@ -77,10 +114,16 @@ static inline void clr_mie(uint64_t mask){ w_mie(r_mie() & ~mask); }
 #define MIE_MTIE    (1ULL << 7)   /* 机器定时器中断 */
 #define MIE_MEIE    (1ULL << 11)  /* 机器外部中断 */
 
+/* 全局中断开关 */
+static inline void intr_on(void){ set_mstatus(MSTATUS_MIE); }
+static inline void intr_off(void){ clr_mstatus(MSTATUS_MIE); }
+static inline int  intr_get(void){ return (r_mstatus() & MSTATUS_MIE) != 0; }
+
 /* QEMU virt 平台 CLINT 基址与寄存器 */
 #define CLINT_BASE         0x02000000ULL
 #define CLINT_MTIMECMP(h) (CLINT_BASE + 0x4000ULL + 8ULL*(h))
 #define CLINT_MTIME       (CLINT_BASE + 0xBFF8ULL)
+#define CLINT_MSIP(h)     (CLINT_BASE + 4ULL*(h))   /* 32 位，写 1 向 hart h 发软件中断，写 0 清除 */
 
 /* 读写CLINT 64位寄存器 */
 static inline uint64_t clint_read64(uint64_t addr){
@@ -92,6 +135,11 @@ static inline void clint_write64(uint64_t addr, uint64_t val){
     *p = val;
 }
 
+static inline void clint_write32(uint64_t addr, uint32_t val){
+    volatile uint32_t *p = (volatile uint32_t*)addr;
+    *p = val;
+}
+
 /* 读写 mideleg/medeleg（用来在 M-mode 委托给 S-mode） */
 static inline uint64_t r_mideleg(void){ uint64_t x; asm volatile("csrr %0, mideleg":"=r"(x)); return x; }
 static inline void     w_mideleg(uint64_t x){ asm volatile("csrw mideleg, %0"::"r"(x)); }
@@ -0,0 +1,45 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include "spinlock.h"
+
+/* 缓存行大小：按类型创建的缓存默认按此对齐，避免对象跨行/伪共享 */
+#define CACHE_LINE_SIZE 64
+
+/* kmalloc 使用 slab 的最大对象尺寸，更大的请求直接按页分配 */
+#define KMALLOC_MAX_CACHE_SIZE 1024
+
+struct slab;
+
+/* 对象缓存：同一类型/尺寸的对象从单页 slab 中切分 */
+struct kmem_cache {
+    const char *name;
+    uint32_t size;            /* 对齐后的对象尺寸 */
+    uint32_t align;
+    uint32_t offset;          /* 页内第一个对象的偏移（跳过 slab 头） */
+    uint32_t objs_per_slab;
+    struct slab *partial;     /* 还有空闲对象的 slab */
+    struct slab *full;        /* 已满的 slab */
+    uint64_t nslabs;
+    uint64_t active;          /* 已分配对象数 */
+    struct kmem_cache *next;  /* 全局缓存链表，用于 kmem_dump */
+    struct spinlock lock;     /* 保护 partial/full 链表和计数 */
+};
+
+/* 初始化 kmalloc 尺寸类缓存（需在 pmm_init 之后调用） */
+void kmem_init(void);
+
+/* 创建对象缓存；align 为 0 时按 8 字节对齐 */
+struct kmem_cache *kmem_cache_create(const char *name, uint32_t size, uint32_t align);
+void *kmem_cache_alloc(struct kmem_cache *c);
+void kmem_cache_free(struct kmem_cache *c, void *obj);
+
+/* 通用小对象分配 */
+void *kmalloc(uint64_t size);
+void kfree(void *ptr);
+
+/* 打印所有缓存的使用情况 */
+void kmem_dump(void);
+
+#endif
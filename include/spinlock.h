@@ -0,0 +1,28 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+
+struct cpu;
+
+/* 自旋锁：持有期间本 hart 关中断（因此也不会被抢占） */
+struct spinlock {
+    volatile uint32_t locked;
+    const char *name;
+    struct cpu *cpu;          /* 持有者，用于检查重复获取 */
+};
+
+/* 静态定义的锁用它初始化 */
+#define SPINLOCK_INIT(n) { 0, (n), 0 }
+
+void initlock(struct spinlock *lk, const char *name);
+void acquire(struct spinlock *lk);
+int try_acquire(struct spinlock *lk);   /* 已被持有（包括本 hart 自己）时返回 0 */
+void release(struct spinlock *lk);
+int holding(struct spinlock *lk);
+
+/* 可嵌套的关中断：最外层 pop_off 恢复第一次 push_off 前的状态 */
+void push_off(void);
+void pop_off(void);
+
+#endif
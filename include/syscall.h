@@ -16,8 +16,33 @@
 #define SYS_fork    7
 #define SYS_open    8   // 新增：打开文件
 #define SYS_close   9   // 新增：关闭文件
+#define SYS_sbrk    10  // 调整堆大小，返回旧的末尾地址
+#define SYS_mmap    11  // 私有映射文件：mmap(fd, len, prot)，prot 使用 PTE_R/PTE_W
+#define SYS_meminfo 12  // 内存统计：meminfo(struct pmm_stats *buf)，buf 为 0 时打印到控制台
+#define SYS_setpriority 13  // 设置调度优先级：setpriority(pid, nice)，pid 为 0 表示自己
+#define SYS_nanosleep   14  // 睡眠：nanosleep(ns)，由内核定时器唤醒，被杀死时返回 -1
+#define SYS_waitpid     15  // 等待子进程：waitpid(pid, status, options)，pid 为 -1 等任意子进程，options 可为 WNOHANG
+#define SYS_trace       16  // 跟踪开关：trace(mask)，mask 第 n 位为 1 时打印第 n 号系统调用的参数和返回值
+#define SYS_ring_setup  17  // 建立提交/完成环：ring_setup()，返回共享页地址（struct ring，见 ring.h），失败返回 -1
+#define SYS_ring_enter  18  // 执行已提交的请求：ring_enter(to_submit)，同步完成，返回执行的个数
+#define SYS_MAX     18  // 最大系统调用号
 
-/* 由 trap 调用：saved 指向 kernelvec.S 保存的寄存器区 */
-void handle_syscall(uint64 *saved);
+/* 耗时直方图格数：第 i 格为 [2^i, 2^(i+1)) 个周期 */
+#define SYSCALL_HIST_BUCKETS 24
+
+/* 由 kernelvec.S 的 ecall 入口调用：args 为保存的 a0..a7，参数取自 a0..a5，调用号取自 a7。
+   ecall 按普通函数调用约定处理：调用者保存寄存器（ra、t0-t6、a0-a7）都可能被改写 */
+long handle_syscall(uint64 *args);
+
+/* read/write/open 的实现（含缓冲区与路径名的地址检查），ring.c 的批量请求也走这里 */
+long do_read(int fd, void *buf, long count);
+long do_write(long fd, const char *buf, long cnt);
+long do_open(const char *pathname, int flags);
+
+/* 各系统调用的次数与耗时直方图 */
+void syscall_stats_dump(void);
+
+/* 跟踪点开关（按调用号的位掩码），也可由 SYS_trace 设置 */
+extern volatile uint64 syscall_trace_mask;
 
 #endif
\ No newline at end of file
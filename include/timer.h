@@ -0,0 +1,26 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* 内核定时器：按 mtime 截止时间组成最小堆，各 hart 共用。
+   到期后在时钟中断中（关中断、不持有定时器锁）调用 fn(arg)，fn 不能睡眠 */
+
+#define NTIMER 128   /* 同时挂起的定时器上限 */
+
+struct ktimer {
+    uint64_t expires;         /* 截止时间（mtime 计数） */
+    void (*fn)(void *arg);
+    void *arg;
+    int index;                /* 在堆中的下标，未挂起为 -1 */
+};
+
+void timer_init(struct ktimer *t, void (*fn)(void *arg), void *arg);
+int timer_add(struct ktimer *t, uint64_t expires);   /* 已挂起则改期；堆满返回 -1 */
+/* 取消时仍挂起返回 1，已到期或未挂起返回 0。回调正在其他 hart 上执行时等它返回，
+   所以调用者不能持有回调要拿的锁 */
+int timer_cancel(struct ktimer *t);
+uint64_t timer_next_deadline(void);                  /* 最早的截止时间，没有定时器时为 ~0 */
+void timer_run(uint64_t now);                        /* 运行所有已到期的定时器（时钟中断调用） */
+
+#endif
@@ -7,10 +7,20 @@ typedef unsigned int       uint32;
 
 // 时钟频率与节拍周期（QEMU virt: mtime约10MHz，1_000_000约0.1秒）
 #define TICK_INTERVAL 1000000ULL
+#define MTIME_FREQ    10000000ULL  // mtime 计数频率（Hz）
+
+// 无节拍空闲：空闲时最多睡这么多个节拍（到期前没有任何事件也醒来一次）
+#define TICK_IDLE_MAX 100
 
 // 对外接口
 void trap_init(void);     // 设置mtvec、初始化mtimecmp、开启M态定时器中断与全局中断
+void trap_inithart(void); // 同上，只作用于当前 hart（副 hart 启动时调用）
 uint64 get_time(void);    // 读取mtime
+void timer_rearm(void);      // 按下一个节拍与最早的内核定时器中较早者设置本 hart 的 mtimecmp
+void timer_idle_enter(void); // 调度器空闲（已关中断）：停掉周期节拍，定时器改为下一个真正的截止时间
+void timer_idle_exit(void);  // 空闲醒来：按 mtime 补上错过的节拍，恢复周期节拍
+void tickless_dump(void);    // 打印各 hart 的无节拍空闲统计
+void ipi_send(int hart);     // 向 hart 发软件中断，把它从 wfi 中唤醒
 extern volatile uint64 ticks; // 节拍计数
 
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include "riscv.h"
+#include "memlayout.h"
+
+/* 内核维护、进程只读的数据页：节拍、mtime 频率与基准、各 hart 当前进程 pid 和切换计数。
+   查询时间和自身 pid 直接读这一页，不需要 ecall。
+   全局字段在时钟中断中由把节拍推进到新值的 hart（ticks_advance 中 CAS 成功者）更新，可能来自任何 hart：
+   用 seq 做顺序锁，写者之间再由 vdso_lock 互斥，保证 seq 的奇偶不会被两个写者交错打乱；每个 hart 一组 pid/切换计数，
+   由该 hart 的调度器更新，各自带一个 seq */
+
+struct vdso_cpu {
+    volatile uint32_t seq;       /* 奇数表示正在更新；每次切换进程加 2 */
+    volatile int32_t pid;        /* 当前运行进程的 pid，0 表示调度器/空闲 */
+    volatile uint64_t nswitch;   /* 切换到进程的次数 */
+    volatile uint64_t nidle;     /* 进入无节拍空闲的次数 */
+};
+
+struct vdso_data {
+    volatile uint32_t seq;       /* 全局字段的顺序锁 */
+    uint32_t ncpu;
+    volatile uint64_t ticks;     /* 同全局 ticks */
+    uint64_t mtime_freq;         /* mtime 计数频率（Hz） */
+    uint64_t tick_interval;      /* 每个节拍的 mtime 计数 */
+    uint64_t mtime_base;         /* 启动时的 mtime，vdso_uptime_ns 以此为零点 */
+    struct vdso_cpu cpu[NCPU];
+};
+
+/* 进程只通过 const 指针访问 */
+extern const struct vdso_data *const vdso;
+
+/* 内核侧更新接口 */
+void vdso_init(void);
+void vdso_set_ticks(uint64_t ticks);     /* 推进全局节拍时调用 */
+void vdso_set_current(int pid);          /* 调度器切换进程前后调用，pid 0 表示回到调度器 */
+void vdso_idle(void);                    /* 本 hart 进入无节拍空闲 */
+
+/* ====== 进程侧辅助函数（不陷入内核）====== */
+
+static inline uint64_t vdso_ticks(void) {
+    uint32_t s;
+    uint64_t t;
+    do {
+        s = vdso->seq;
+        __sync_synchronize();
+        t = vdso->ticks;
+        __sync_synchronize();
+    } while ((s & 1) || s != vdso->seq);
+    return t;
+}
+
+/* 启动以来的纳秒数：mtime 直接读取，换算参数来自数据页 */
+static inline uint64_t vdso_uptime_ns(void) {
+    uint64_t d = clint_read64(CLINT_MTIME) - vdso->mtime_base;
+    uint64_t f = vdso->mtime_freq;
+    return d / f * 1000000000ULL + d % f * 1000000000ULL / f;
+}
+
+/* 当前进程 pid：读本 hart 的一项，期间 seq 不变且仍在同一个 hart 上，说明没有发生切换 */
+static inline int vdso_getpid(void) {
+    for (;;) {
+        uint64_t h = r_mhartid();
+        const struct vdso_cpu *c = &vdso->cpu[h];
+        uint32_t s = c->seq;
+        __sync_synchronize();
+        int pid = c->pid;
+        __sync_synchronize();
+        if (!(s & 1) && s == c->seq && r_mhartid() == h) return pid;
+    }
+}
+
+#endif
@@ -12,7 +12,63 @@ void kvminithart(void);
 /* 创建一个空的页表 */
 pagetable_t create_pagetable(void);
 
-/* 映射一个区域 */
+/* 映射一个区域（自动使用大页） */
 int map_region(pagetable_t pt, uint64_t va, uint64_t pa, uint64_t size, int perm);
 
+/* 内核页表 */
+extern pagetable_t kernel_pagetable;
+
+struct proc;
+
+/* 切换 satp 到进程的地址空间（带 ASID，0 表示内核页表） */
+void vm_activate(struct proc *p);
+uint64_t proc_asid(struct proc *p);
+
+/* 进程地址空间：[USERBASE, USERBASE+sz) */
+pagetable_t uvm_create(void);
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, int perm);
+uint64_t uvm_alloc(pagetable_t pagetable, uint64_t oldsz, uint64_t newsz);
+void uvm_unmap(pagetable_t pagetable, uint64_t as, uint64_t start, uint64_t end);
+void uvm_free(pagetable_t pagetable);
+
+/* 写时复制 fork 支持 */
+int uvm_cow_copy(pagetable_t old, uint64_t old_as, pagetable_t new, uint64_t start, uint64_t end);
+int cow_fault(pagetable_t pagetable, uint64_t as, uint64_t va);
+
+/* 进程虚拟内存区域（VMA）：页面在首次访问时由 vm_fault 建立 */
+#define NVMA 8
+enum vma_type { VMA_NONE, VMA_HEAP, VMA_STACK, VMA_FILE };
+
+struct vma {
+    uint64_t start, end;   /* [start, end)，页对齐 */
+    int perm;              /* PTE_R/W/X */
+    int type;
+    int fid;               /* VMA_FILE：文件索引 */
+    uint64_t off;          /* VMA_FILE：映射起点在文件中的偏移 */
+};
+
+struct vma *vma_find(struct proc *p, uint64_t va);
+struct vma *vma_add(struct proc *p, uint64_t start, uint64_t end, int perm, int type);
+void proc_vm_init(struct proc *p);
+int proc_vm_fork(struct proc *p, struct proc *np);
+void proc_vm_free(struct proc *p);
+int proc_vm_setbrk(struct proc *p, uint64_t newsz);
+uint64_t proc_vm_mmap_file(struct proc *p, int fd, uint64_t len, int perm);
+/* 缺页类型：读缺页为 0 */
+#define FAULT_WRITE 1
+#define FAULT_EXEC  2
+int vm_fault(struct proc *p, uint64_t va, int access);   /* access 为 FAULT_* 的组合 */
+int vm_reclaim(int target);
+
+/* 进程内存与内核缓冲区之间拷贝：用户地址逐页查页表（必要时按缺页装入），
+   成功返回 0（copyinstr 返回字符串长度），地址非法返回 -EFAULT */
+int copyin(struct proc *p, void *dst, uint64_t srcva, uint64_t len);
+int copyout(struct proc *p, uint64_t dstva, const void *src, uint64_t len);
+int copyinstr(struct proc *p, char *dst, uint64_t srcva, uint64_t max);
+/* 内核地址 [va, va+len) 能否作为 p 的缓冲区直接使用（write 为 1 表示内核要写入） */
+int kernel_buf_ok(struct proc *p, uint64_t va, uint64_t len, int write);
+
+/* 查找映射 va 的叶子PTE（可能是大页），level 返回叶子所在级 */
+pte_t* walk_leaf(pagetable_t pagetable, uint64_t va, int *level);
+
 #endif
\ No newline at end of file
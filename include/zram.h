@@ -0,0 +1,24 @@
+#ifndef ZRAM_H
+#define ZRAM_H
+
+#include <stdint.h>
+
+/* 压缩内存交换区：内存紧张时匿名页被压缩存入 slot，缺页时解压回来 */
+
+#define ZRAM_NSLOTS     4096   /* 最多可换出的页数 */
+#define ZRAM_MAX_CHUNKS 3      /* 压缩数据拆成至多 3 块 kmalloc(1024) 存放 */
+
+/* 每次分配失败时尝试回收的页数 */
+#define ZRAM_RECLAIM_BATCH 16
+
+/* 换出后的 PTE：V=0、PTE_SWAP=1，PPN 字段存 slot 号，低位保留原权限 */
+#define PTE_SWAP (1L << 9)     /* RSW 软件位 */
+#define SWAP_PTE(slot, flags) (((uint64_t)(slot) << 10) | ((flags) & 0x3FF & ~PTE_V) | PTE_SWAP)
+#define PTE2SLOT(pte) ((int)((pte) >> 10))
+
+int zram_store(const void *page);           /* 压缩保存一页，返回 slot；不可压缩或无空间返回 -1 */
+int zram_load(int slot, void *page);        /* 解压到 page，成功返回 0 */
+void zram_free(int slot);
+void zram_dump(void);
+
+#endif
@@ -0,0 +1,234 @@
+#include "riscv.h"
+#include "printf.h"
+#include "pmm.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "syscall.h"
+#include "trap.h"
+#include "fs.h"
+#include "vdso.h"
+
+/* 内核基准测试（make bench 生成的独立镜像运行）：测量调度、系统调用、内存和文件系统热路径。
+   每项重复 n 次，以 mcycle 计数，输出一行便于脚本解析的结果：
+   bench: name=<项目> n=<次数> min=<最小> median=<中位数> p99=<99 分位> unit=cycles */
+
+#define BENCH_NSAMPLE 256
+#define BENCH_NSPAWN  64    /* fork/创建+回收进程的轮数（受 NPROC 和内存限制，少测一些） */
+
+static uint64 samples[BENCH_NSAMPLE];
+
+static void report(const char *name, uint64 *s, int n) {
+    /* 插入排序：样本很少 */
+    for (int i = 1; i < n; i++) {
+        uint64 v = s[i];
+        int j = i - 1;
+        while (j >= 0 && s[j] > v) {
+            s[j + 1] = s[j];
+            j--;
+        }
+        s[j + 1] = v;
+    }
+    printf("bench: name=%s n=%d min=%lu median=%lu p99=%lu unit=cycles\n", name, n,
+           (unsigned long)s[0], (unsigned long)s[n / 2], (unsigned long)s[n * 99 / 100]);
+}
+
+static long bench_syscall(long num, long a0, long a1, long a2) {
+    long ret;
+    asm volatile(
+        "mv a0, %1\n"
+        "mv a1, %2\n"
+        "mv a2, %3\n"
+        "mv a7, %4\n"
+        "ecall\n"
+        "mv %0, a0\n"
+        : "=r"(ret)
+        : "r"(a0), "r"(a1), "r"(a2), "r"(num)
+        /* ecall 按函数调用约定处理：调用者保存寄存器都可能被改写 */
+        : "ra","t0","t1","t2","t3","t4","t5","t6",
+          "a0","a1","a2","a3","a4","a5","a6","a7","memory"
+    );
+    return ret;
+}
+
+/* ====== swtch 往返：两个上下文之间直接切换，不经过调度器 ====== */
+
+static struct context ctx_main, ctx_peer;
+static char peer_stack[PGSIZE] __attribute__((aligned(16)));
+
+static void swtch_peer(void) {
+    for (;;) swtch(&ctx_peer, &ctx_main);
+}
+
+static void bench_swtch(void) {
+    ctx_peer.ra = (uint64)swtch_peer;
+    ctx_peer.sp = (uint64)(peer_stack + sizeof(peer_stack));
+    /* 关中断：避免在借来的栈上被抢占 */
+    push_off();
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        swtch(&ctx_main, &ctx_peer);
+        samples[i] = r_mcycle() - t0;
+    }
+    pop_off();
+    report("swtch_roundtrip", samples, BENCH_NSAMPLE);
+}
+
+/* ====== yield 乒乓：另一个进程也在不停 yield，一次往返包含两次进程切换 ====== */
+
+static volatile int pingpong_done;
+
+static void pingpong_peer(void) {
+    while (!pingpong_done) yield();
+}
+
+static void bench_yield(void) {
+    pingpong_done = 0;
+    if (create_process(pingpong_peer) < 0) {
+        printf("bench: yield_pingpong skipped (no process slot)\n");
+        return;
+    }
+    yield();   /* 让对方先跑起来 */
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        yield();
+        samples[i] = r_mcycle() - t0;
+    }
+    pingpong_done = 1;
+    report("yield_pingpong", samples, BENCH_NSAMPLE);
+}
+
+/* ====== 空系统调用：ecall -> ecall_entry -> handle_syscall(SYS_getpid) -> mret ====== */
+
+static void bench_ecall(void) {
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        bench_syscall(SYS_getpid, 0, 0, 0);
+        samples[i] = r_mcycle() - t0;
+    }
+    report("ecall_getpid", samples, BENCH_NSAMPLE);
+}
+
+/* ====== 同样的查询走只读数据页 ====== */
+
+static void bench_vdso(void) {
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        vdso_getpid();
+        samples[i] = r_mcycle() - t0;
+    }
+    report("vdso_getpid", samples, BENCH_NSAMPLE);
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        vdso_uptime_ns();
+        samples[i] = r_mcycle() - t0;
+    }
+    report("vdso_uptime", samples, BENCH_NSAMPLE);
+}
+
+/* ====== fork + waitpid：子进程从 fork 返回 0 后立即退出，测量复制、调度、退出和回收的总耗时 ====== */
+
+static void bench_fork(void) {
+    int n = 0;
+    for (int i = 0; i < BENCH_NSPAWN; i++) {
+        uint64 t0 = r_mcycle();
+        long pid = bench_syscall(SYS_fork, 0, 0, 0);
+        if (pid == 0) bench_syscall(SYS_exit, 0, 0, 0);
+        if (pid < 0 || bench_syscall(SYS_waitpid, pid, 0, 0) < 0) break;
+        samples[n++] = r_mcycle() - t0;
+    }
+    if (n > 0) report("fork_wait", samples, n);
+}
+
+/* ====== 对照：allocproc 直接建立子进程 + waitpid 回收 ======
+   不复制父进程的内核栈和地址空间，与 fork_wait 的差值即为 fork 复制的开销 */
+
+static void spawn_child(void) {
+    exit_process(0);
+}
+
+static void bench_spawn(void) {
+    struct proc *me = myproc();
+    int n = 0;
+    for (int i = 0; i < BENCH_NSPAWN; i++) {
+        uint64 t0 = r_mcycle();
+        struct proc *np = allocproc();
+        if (np == 0) break;
+        np->entry = spawn_child;
+        acquire(&proc_lock);
+        proc_add_child(me, np);
+        proc_setrunnable(np);
+        release(&proc_lock);
+        int status;
+        if (waitpid(np->pid, &status, 0) < 0) break;
+        samples[n++] = r_mcycle() - t0;
+    }
+    if (n > 0) report("spawn_wait", samples, n);
+}
+
+/* ====== 物理页分配 ====== */
+
+static void bench_page(void) {
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        void *pa = alloc_page();
+        free_page(pa);
+        samples[i] = r_mcycle() - t0;
+    }
+    report("alloc_free_page", samples, BENCH_NSAMPLE);
+}
+
+/* ====== 文件系统：open/write/read/close 各自计时 ====== */
+
+static uint64 fs_samples[4][BENCH_NSAMPLE];
+
+static void bench_fs(void) {
+    char buf[64];
+    for (int i = 0; i < (int)sizeof(buf); i++) buf[i] = 'a' + i % 26;
+    for (int i = 0; i < BENCH_NSAMPLE; i++) {
+        uint64 t0 = r_mcycle();
+        int fd = fs_open("bench", O_CREATE | O_RDWR);
+        uint64 t1 = r_mcycle();
+        fs_write_fd(fd, buf, sizeof(buf));
+        uint64 t2 = r_mcycle();
+        fs_close(fd);
+        fd = fs_open("bench", O_RDONLY);
+        uint64 t3 = r_mcycle();
+        fs_read_fd(fd, buf, sizeof(buf));
+        uint64 t4 = r_mcycle();
+        fs_close(fd);
+        uint64 t5 = r_mcycle();
+        fs_samples[0][i] = t1 - t0;
+        fs_samples[1][i] = t2 - t1;
+        fs_samples[2][i] = t4 - t3;
+        fs_samples[3][i] = t5 - t4;
+        if (fd < 0) {
+            printf("bench: fs skipped (open failed)\n");
+            return;
+        }
+    }
+    fs_unlink("bench");
+    report("fs_open", fs_samples[0], BENCH_NSAMPLE);
+    report("fs_write", fs_samples[1], BENCH_NSAMPLE);
+    report("fs_read", fs_samples[2], BENCH_NSAMPLE);
+    report("fs_close", fs_samples[3], BENCH_NSAMPLE);
+}
+
+static void bench_task(void) {
+    printf("bench: start\n");
+    bench_swtch();
+    bench_ecall();
+    bench_vdso();
+    bench_yield();
+    bench_fork();
+    bench_spawn();
+    bench_page();
+    bench_fs();
+    syscall_stats_dump();
+    printf("bench: done\n");
+}
+
+void bench_init(void) {
+    if (create_process(bench_task) < 0) {
+        printf("bench_init: create_process failed\n");
+    }
+}
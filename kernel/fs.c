@@ -1,145 +1,219 @@
 #include "fs.h"
+#include "riscv.h"
 #include "pmm.h"
+#include "slab.h"
+#include "spinlock.h"
 #include "printf.h"
 #include <stdint.h>
 
 #define FS_MAX_FILES 16
 #define FS_NAME_LEN  32
-#define FS_PAGE_SIZE 4096
+#define FS_PAGE_SIZE 4096      // 单个文件最大长度
+#define FS_MIN_CAP   32        // 文件数据缓冲区的最小容量
 #define FS_MAX_FD_PER_PROC 16  // 最大文件描述符数（全局共享）
 
 struct fs_file {
-    int used;
     char name[FS_NAME_LEN];
-    void *data;   /* page allocated by pmm */
+    void *data;    /* 数据缓冲区，按需增长（见 fs_data_alloc） */
     int size;
-    int refcount;  /* 引用计数，支持多个文件描述符指向同一文件 */
+    int cap;       /* data 缓冲区容量 */
+    int refcount;  /* 引用计数：文件描述符和文件映射（VMA）各持有一个 */
+    int unlinked;  /* 已删除但仍被引用：名字已清除，引用归零时释放 */
 };
 
 // 文件描述符表项
 struct fd_entry {
-    int used;
     int file_idx;  /* 指向files数组的索引 */
     int offset;    /* 文件位置指针 */
 };
 
 // 文件描述符表（进一步简化：不区分进程，所有进程共享一个全局FD表）
-static struct fd_entry fd_table[FS_MAX_FD_PER_PROC];
+// 表项为空指针表示空闲，表项对象从 fd_cache 分配
+static struct fd_entry *fd_table[FS_MAX_FD_PER_PROC];
 
-static struct fs_file files[FS_MAX_FILES];
+static struct fs_file *files[FS_MAX_FILES];
 
-/* 新增：跟踪通过 fs 分配的页数，便于调试输出 */
-static int fs_alloc_pages = 0;
+static struct kmem_cache *file_cache;
+static struct kmem_cache *fd_cache;
+
+/* 保护 files[]、fd_table[] 及文件内容（多个 hart 上的进程可能同时访问） */
+static struct spinlock fs_lock = SPINLOCK_INIT("fs");
+
+/* 跟踪文件数据占用的字节数（缓冲区容量），便于调试输出 */
+static int fs_data_bytes = 0;
 
 void fs_init(void){
+    if (!file_cache) {
+        file_cache = kmem_cache_create("fs_file", sizeof(struct fs_file), CACHE_LINE_SIZE);
+        fd_cache = kmem_cache_create("fd_entry", sizeof(struct fd_entry), 0);
+    }
     for (int i = 0; i < FS_MAX_FILES; i++) {
-        files[i].used = 0;
-        files[i].data = 0;
-        files[i].size = 0;
-        files[i].name[0] = 0;
-        files[i].refcount = 0;  // 新增
+        files[i] = 0;
     }
     // 初始化文件描述符表
     for (int f = 0; f < FS_MAX_FD_PER_PROC; f++) {
-        fd_table[f].used = 0;
-        fd_table[f].file_idx = -1;
-        fd_table[f].offset = 0;
+        fd_table[f] = 0;
     }
-    fs_alloc_pages = 0;
+    fs_data_bytes = 0;
     printf("fs: simple in-memory fs initialized.\n");
 }
 
 /* 新增：打印当前 fs 状态 */
 void fs_print_info(void){
     int used = 0;
-    printf("fs: summary: alloc_pages=%d\n", fs_alloc_pages);
+    acquire(&fs_lock);
+    printf("fs: summary: data_bytes=%d\n", fs_data_bytes);
     printf("fs: files:\n");
     for (int i = 0; i < FS_MAX_FILES; i++) {
-        if (files[i].used) {
+        if (files[i]) {
             used++;
-            printf("  slot=%d name=\"%s\" size=%d data=%p\n", i, files[i].name, files[i].size, files[i].data);
+            printf("  slot=%d name=\"%s\" size=%d cap=%d data=%p\n", i, files[i]->name, files[i]->size, files[i]->cap, files[i]->data);
         }
     }
     if (used == 0) printf("  (no files)\n");
+    release(&fs_lock);
 }
 
 static int find_slot(void){
-    for (int i = 0; i < FS_MAX_FILES; i++) if (!files[i].used) return i;
+    for (int i = 0; i < FS_MAX_FILES; i++) if (!files[i]) return i;
     return -1;
 }
 
 static int find_by_name(const char *name){
     for (int i = 0; i < FS_MAX_FILES; i++) {
-        if (files[i].used) {
-            int j=0; for (; j<FS_NAME_LEN && name[j] && files[i].name[j]; j++) if (files[i].name[j]!=name[j]) break;
-            if (j==FS_NAME_LEN || (name[j]==0 && files[i].name[j]==0)) return i;
+        if (files[i] && !files[i]->unlinked) {
+            int j=0; for (; j<FS_NAME_LEN && name[j] && files[i]->name[j]; j++) if (files[i]->name[j]!=name[j]) break;
+            if (j==FS_NAME_LEN || (name[j]==0 && files[i]->name[j]==0)) return i;
         }
     }
     return -1;
 }
 
-int fs_create(const char *name){
+/* 文件数据缓冲区：满一页时直接用整页（kmalloc 的大块带头部，4KB 会占用 8KB），其余走 kmalloc */
+static void* fs_data_alloc(int cap){
+    void *d = cap == FS_PAGE_SIZE ? alloc_page_nozero() : kmalloc(cap);
+    if (d && cap > KMALLOC_MAX_CACHE_SIZE) pmm_set_tag((void*)PGROUNDDOWN((uint64_t)d), PMM_TAG_FS);
+    return d;
+}
+
+static void fs_data_free(void *d, int cap){
+    if (!d) return;
+    if (cap == FS_PAGE_SIZE) free_page(d);
+    else kfree(d);
+}
+
+/* 保证文件缓冲区至少能容纳 need 字节（不超过 FS_PAGE_SIZE），按 2 的幂增长 */
+static int fs_reserve(struct fs_file *f, int need){
+    if (need <= f->cap) return 0;
+    int cap = f->cap ? f->cap : FS_MIN_CAP;
+    while (cap < need) cap <<= 1;
+    if (cap > FS_PAGE_SIZE) cap = FS_PAGE_SIZE;
+    char *nd = (char*)fs_data_alloc(cap);
+    if (!nd) return -1;
+    char *od = (char*)f->data;
+    for (int i = 0; i < f->size; i++) nd[i] = od[i];
+    fs_data_free(od, f->cap);
+    fs_data_bytes += cap - f->cap;
+    f->data = nd;
+    f->cap = cap;
+    return 0;
+}
+
+static int fs_create_locked(const char *name) {
     if (!name) return -1;
     if (find_by_name(name) >= 0) return -1; /* already exists */
     int s = find_slot();
     if (s < 0) return -1;
-    files[s].data = alloc_page();
-    if (!files[s].data) return -1;
-    fs_alloc_pages++; /* 统计 */
-    files[s].used = 1;
-    files[s].size = 0;
+    /* 数据缓冲区推迟到第一次写入时分配 */
+    struct fs_file *f = (struct fs_file*)kmem_cache_alloc(file_cache);
+    if (!f) return -1;
+    f->data = 0;
+    f->size = 0;
+    f->cap = 0;
+    f->refcount = 0;
+    f->unlinked = 0;
     /* copy name (simple) */
-    for (int i=0;i<FS_NAME_LEN;i++){ char c = name[i]; files[s].name[i]=c; if (!c) break; }
+    for (int i=0;i<FS_NAME_LEN;i++){ char c = name[i]; f->name[i]=c; if (!c) break; }
+    files[s] = f;
     return s;
 }
 
-int fs_write(int fid, const void *buf, int len){
+static int fs_write_locked(int fid, const void *buf, int len) {
     if (fid < 0 || fid >= FS_MAX_FILES) return -1;
-    if (!files[fid].used) return -1;
+    if (!files[fid]) return -1;
     if (!buf) return -1;
     if (len < 0) return -1;
     if (len > FS_PAGE_SIZE) len = FS_PAGE_SIZE;
+    if (fs_reserve(files[fid], len) < 0) return -1;
     /* copy */
-    char *dst = (char*)files[fid].data;
+    char *dst = (char*)files[fid]->data;
     const char *src = (const char*)buf;
     for (int i=0;i<len;i++) dst[i]=src[i];
-    files[fid].size = len;
+    files[fid]->size = len;
     return len;
 }
 
-int fs_read(int fid, void *buf, int len){
+static int fs_read_locked(int fid, void *buf, int len) {
     if (fid < 0 || fid >= FS_MAX_FILES) return -1;
-    if (!files[fid].used) return -1;
+    if (!files[fid]) return -1;
     if (!buf) return -1;
     if (len < 0) return -1;
-    if (len > files[fid].size) len = files[fid].size;
+    if (len > files[fid]->size) len = files[fid]->size;
+    char *dst = (char*)buf;
+    char *src = (char*)files[fid]->data;
+    for (int i=0;i<len;i++) dst[i]=src[i];
+    return len;
+}
+
+/* 从文件 fid 的 off 处读取最多 len 字节（供文件映射缺页装入使用） */
+static int fs_read_at_locked(int fid, uint64_t off, void *buf, int len) {
+    if (fid < 0 || fid >= FS_MAX_FILES) return -1;
+    if (!files[fid] || !buf || len < 0) return -1;
+    if (off >= (uint64_t)files[fid]->size) return 0;
+    if (len > files[fid]->size - (int)off) len = files[fid]->size - (int)off;
     char *dst = (char*)buf;
-    char *src = (char*)files[fid].data;
+    char *src = (char*)files[fid]->data + off;
     for (int i=0;i<len;i++) dst[i]=src[i];
     return len;
 }
 
-int fs_unlink(const char *name){
+static void fs_file_free_locked(int idx) {
+    struct fs_file *f = files[idx];
+    fs_data_free(f->data, f->cap);
+    fs_data_bytes -= f->cap; /* 更新统计 */
+    files[idx] = 0;
+    kmem_cache_free(file_cache, f);
+}
+
+/* 删除文件：仍被描述符或映射引用时只摘掉名字，槽位保留到最后一个引用释放，
+   这期间槽位不会被新文件复用，映射读到的仍是原来的数据 */
+static int fs_unlink_locked(const char *name) {
     int idx = find_by_name(name);
     if (idx < 0) return -1;
-    free_page(files[idx].data);
-    fs_alloc_pages--; /* 更新统计 */
-    files[idx].data = 0;
-    files[idx].used = 0;
-    files[idx].size = 0;
-    files[idx].name[0] = 0;
+    if (files[idx]->refcount > 0) {
+        files[idx]->unlinked = 1;
+        files[idx]->name[0] = 0;
+        return 0;
+    }
+    fs_file_free_locked(idx);
     return 0;
 }
 
+/* 释放一个文件引用 */
+static void fs_file_put_locked(int idx) {
+    if (idx < 0 || idx >= FS_MAX_FILES || !files[idx]) return;
+    if (--files[idx]->refcount == 0 && files[idx]->unlinked) fs_file_free_locked(idx);
+}
+
 /* 打开文件，返回文件描述符 */
-int fs_open(const char *name, int flags) {
+static int fs_open_locked(const char *name, int flags) {
     if (!name) return -1;
     
     int file_idx = find_by_name(name);
     if (file_idx < 0) {
         // 文件不存在，如果flags包含O_CREATE则创建
         if (flags & 0x200) {  // O_CREATE标志（简化）
-            file_idx = fs_create(name);
+            file_idx = fs_create_locked(name);
             if (file_idx < 0) return -1;
         } else {
             return -1;  // 文件不存在且不创建
@@ -148,76 +222,81 @@ int fs_open(const char *name, int flags) {
     
     // 查找空闲的文件描述符
     for (int fd = 0; fd < FS_MAX_FD_PER_PROC; fd++) {
-        if (!fd_table[fd].used) {
-            fd_table[fd].used = 1;
-            fd_table[fd].file_idx = file_idx;
-            fd_table[fd].offset = 0;  // 从文件开头开始
-            files[file_idx].refcount++;  // 增加引用计数
+        if (!fd_table[fd]) {
+            struct fd_entry *e = (struct fd_entry*)kmem_cache_alloc(fd_cache);
+            if (!e) return -1;
+            e->file_idx = file_idx;
+            e->offset = 0;  // 从文件开头开始
+            fd_table[fd] = e;
+            files[file_idx]->refcount++;  // 增加引用计数
             return fd;
         }
     }
     return -1;  // 文件描述符用尽
 }
 
+/* 返回文件描述符对应的文件索引 */
+static int fs_fd_file_locked(int fd) {
+    if (fd < 0 || fd >= FS_MAX_FD_PER_PROC) return -1;
+    if (!fd_table[fd]) return -1;
+    return fd_table[fd]->file_idx;
+}
+
 /* 关闭文件描述符 */
-int fs_close(int fd) {
+static int fs_close_locked(int fd) {
     if (fd < 0 || fd >= FS_MAX_FD_PER_PROC) return -1;
-    if (!fd_table[fd].used) return -1;
+    if (!fd_table[fd]) return -1;
     
-    int file_idx = fd_table[fd].file_idx;
-    fd_table[fd].used = 0;
-    fd_table[fd].file_idx = -1;
-    fd_table[fd].offset = 0;
+    int file_idx = fd_table[fd]->file_idx;
+    kmem_cache_free(fd_cache, fd_table[fd]);
+    fd_table[fd] = 0;
     
-    if (file_idx >= 0 && file_idx < FS_MAX_FILES) {
-        files[file_idx].refcount--;
-        // 如果引用计数为0，可以考虑释放文件（但当前实现不自动释放）
-    }
+    fs_file_put_locked(file_idx);
     
     return 0;
 }
 
 /* 改进的read：使用文件描述符和位置指针 */
-int fs_read_fd(int fd, void *buf, int len) {
+static int fs_read_fd_locked(int fd, void *buf, int len) {
     if (fd < 0 || fd >= FS_MAX_FD_PER_PROC) return -1;
-    if (!fd_table[fd].used) return -1;
+    if (!fd_table[fd]) return -1;
     
-    int file_idx = fd_table[fd].file_idx;
-    int offset = fd_table[fd].offset;
+    int file_idx = fd_table[fd]->file_idx;
+    int offset = fd_table[fd]->offset;
     
     if (file_idx < 0 || file_idx >= FS_MAX_FILES) return -1;
-    if (!files[file_idx].used) return -1;
+    if (!files[file_idx]) return -1;
     if (!buf) return -1;
     if (len < 0) return -1;
     
     // 计算可读长度
-    int available = files[file_idx].size - offset;
+    int available = files[file_idx]->size - offset;
     if (available <= 0) return 0;  // 已到文件末尾
     if (len > available) len = available;
     
     // 从offset位置读取
     char *dst = (char*)buf;
-    char *src = (char*)files[file_idx].data;
+    char *src = (char*)files[file_idx]->data;
     for (int i = 0; i < len; i++) {
         dst[i] = src[offset + i];
     }
     
     // 更新位置指针
-    fd_table[fd].offset += len;
+    fd_table[fd]->offset += len;
     
     return len;
 }
 
 /* 改进的write：使用文件描述符和位置指针 */
-int fs_write_fd(int fd, const void *buf, int len) {
+static int fs_write_fd_locked(int fd, const void *buf, int len) {
     if (fd < 0 || fd >= FS_MAX_FD_PER_PROC) return -1;
-    if (!fd_table[fd].used) return -1;
+    if (!fd_table[fd]) return -1;
     
-    int file_idx = fd_table[fd].file_idx;
-    int offset = fd_table[fd].offset;
+    int file_idx = fd_table[fd]->file_idx;
+    int offset = fd_table[fd]->offset;
     
     if (file_idx < 0 || file_idx >= FS_MAX_FILES) return -1;
-    if (!files[file_idx].used) return -1;
+    if (!files[file_idx]) return -1;
     if (!buf) return -1;
     if (len < 0) return -1;
     
@@ -226,19 +305,111 @@ int fs_write_fd(int fd, const void *buf, int len) {
         len = FS_PAGE_SIZE - offset;
     }
     if (len <= 0) return 0;
+    if (fs_reserve(files[file_idx], offset + len) < 0) return -1;
     
     // 写入到offset位置
-    char *dst = (char*)files[file_idx].data;
+    char *dst = (char*)files[file_idx]->data;
     const char *src = (const char*)buf;
     for (int i = 0; i < len; i++) {
         dst[offset + i] = src[i];
     }
     
     // 更新文件大小和位置指针
-    if (offset + len > files[file_idx].size) {
-        files[file_idx].size = offset + len;
+    if (offset + len > files[file_idx]->size) {
+        files[file_idx]->size = offset + len;
     }
-    fd_table[fd].offset += len;
+    fd_table[fd]->offset += len;
     
     return len;
-}
\ No newline at end of file
+}
+
+/* 对外接口：文件表、描述符表和文件数据都由 fs_lock 保护 */
+int fs_create(const char *name) {
+    acquire(&fs_lock);
+    int r = fs_create_locked(name);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_write(int fid, const void *buf, int len) {
+    acquire(&fs_lock);
+    int r = fs_write_locked(fid, buf, len);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_read(int fid, void *buf, int len) {
+    acquire(&fs_lock);
+    int r = fs_read_locked(fid, buf, len);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_read_at(int fid, uint64_t off, void *buf, int len) {
+    acquire(&fs_lock);
+    int r = fs_read_at_locked(fid, off, buf, len);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_unlink(const char *name) {
+    acquire(&fs_lock);
+    int r = fs_unlink_locked(name);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_open(const char *name, int flags) {
+    acquire(&fs_lock);
+    int r = fs_open_locked(name, flags);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_fd_file(int fd) {
+    acquire(&fs_lock);
+    int r = fs_fd_file_locked(fd);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_file_get(int fd) {
+    acquire(&fs_lock);
+    int r = fs_fd_file_locked(fd);
+    if (r >= 0) files[r]->refcount++;
+    release(&fs_lock);
+    return r;
+}
+
+void fs_file_dup(int fid) {
+    acquire(&fs_lock);
+    if (fid >= 0 && fid < FS_MAX_FILES && files[fid]) files[fid]->refcount++;
+    release(&fs_lock);
+}
+
+void fs_file_put(int fid) {
+    acquire(&fs_lock);
+    fs_file_put_locked(fid);
+    release(&fs_lock);
+}
+
+int fs_close(int fd) {
+    acquire(&fs_lock);
+    int r = fs_close_locked(fd);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_read_fd(int fd, void *buf, int len) {
+    acquire(&fs_lock);
+    int r = fs_read_fd_locked(fd, buf, len);
+    release(&fs_lock);
+    return r;
+}
+
+int fs_write_fd(int fd, const void *buf, int len) {
+    acquire(&fs_lock);
+    int r = fs_write_fd_locked(fd, buf, len);
+    release(&fs_lock);
+    return r;
+}
@@ -6,11 +6,7 @@
 
 /* demo 任务：等待短时间保证前面实验输出完成，然后演示 fs API */
 static void fs_demo_task(void){
-    extern volatile uint64 ticks;
-    uint64 start = ticks;
-    while (ticks < start + 1) {
-        yield();
-    }
+    sleep_until(get_time() + TICK_INTERVAL);
 
     printf("=== fs demo: start ===\n");
 
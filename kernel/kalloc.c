@@ -2,64 +2,422 @@
 #include "memlayout.h"
 #include "printf.h"
 #include "pmm.h"
+#include "trap.h"
+#include "vmm.h"
+#include "zram.h"
+#include "spinlock.h"
 
 /* 外部符号，由链接脚本定义 */
 extern char end[]; // 内核代码和数据段的末尾
 
-/* 空闲页链表 */
+/* 物理页总数（从 KERNBASE 到 PHYSTOP），用于页描述符数组 */
+#define PMM_NPAGES ((PHYSTOP - KERNBASE) / PGSIZE)
+
+/* 空闲块链表节点（双向，合并伙伴时需要 O(1) 摘除） */
 struct run {
     struct run *next;
+    struct run *prev;
+};
+
+/* 每个物理页的描述符：只有块头页的信息有效 */
+struct page_info {
+    uint8_t order;   /* 所在块的阶 */
+    uint8_t flags;
+    uint8_t tag;     /* 分配者所属子系统（PMM_TAG_*），用于统计 */
+    uint16_t refcnt; /* 引用计数（写时复制共享的页 > 1） */
 };
+#define PG_FREE 0x1  /* 该页是一个空闲块的块头 */
+
+static struct page_info pages[PMM_NPAGES];
+
+/* 预清零页池：空闲时由调度器填充，alloc_page() 优先从这里取 */
+#define ZERO_POOL_SIZE 32
+
+/* Zicboz cbo.zero 每次清零的缓存块大小（QEMU 默认 64 字节） */
+#define CBO_BLOCK_SIZE 64
 
+/* 伙伴系统：每一阶一个空闲链表（带哨兵的循环链表） */
 struct {
-    struct run *freelist;
-} pmm;
+    struct run freelist[PMM_MAX_ORDER + 1];
+    uint64_t nfree[PMM_MAX_ORDER + 1];   /* 每阶空闲块数 */
+    void *zero_pool[ZERO_POOL_SIZE];
+    int nzero;
+    /* 区间描述符：[lazy_next, PHYSTOP) 尚未交给伙伴系统，首次需要时才按最大块切出 */
+    uint64_t lazy_next;
+    /* 已交给调用者的页数统计（预清零池中的页视为空闲） */
+    uint64_t used;
+    uint64_t peak;
+    uint64_t failures;
+    uint64_t by_tag[PMM_NTAGS];
+    int reclaiming;   /* 正在回收：回收过程中的分配失败不再递归回收 */
+    struct spinlock lock;   /* 保护空闲链表、预清零池、区间描述符和统计 */
+} pmm = { .lock = SPINLOCK_INIT("pmm") };
+
+static const char *tag_names[PMM_NTAGS] = {
+    [PMM_TAG_OTHER] = "other", [PMM_TAG_KSTACK] = "kstack", [PMM_TAG_PGTBL] = "pagetable",
+    [PMM_TAG_SLAB] = "slab", [PMM_TAG_USER] = "user", [PMM_TAG_FS] = "fs",
+};
+
+static inline uint64_t pa2idx(void *pa) {
+    return ((uint64_t)pa - KERNBASE) >> PGSHIFT;
+}
+
+static inline void *idx2pa(uint64_t idx) {
+    return (void*)(KERNBASE + (idx << PGSHIFT));
+}
+
+/* 按 64 位字（或 Zicboz 缓存块）清零 2^order 页 */
+static void page_zero(void *pa, int order) {
+    uint64_t *p = (uint64_t*)pa;
+    uint64_t *e = (uint64_t*)((char*)pa + ((uint64_t)PGSIZE << order));
+#ifdef CONFIG_ZICBOZ
+    /* cbo.zero (rs1)：MISC-MEM, funct3=2, imm=4，用 .insn 编码避免依赖汇编器支持 */
+    for (; p < e; p += CBO_BLOCK_SIZE / sizeof(uint64_t)) {
+        asm volatile(".insn i 0x0F, 2, x0, 4(%0)" : : "r"(p) : "memory");
+    }
+#else
+    for (; p < e; p += 8) {
+        p[0] = 0; p[1] = 0; p[2] = 0; p[3] = 0;
+        p[4] = 0; p[5] = 0; p[6] = 0; p[7] = 0;
+    }
+#endif
+}
+
+#ifdef PMM_DEBUG
+/* 调试构建：释放时填充毒化值，便于发现 use-after-free */
+static void page_poison(void *pa, int order) {
+    uint64_t *p = (uint64_t*)pa;
+    uint64_t n = ((uint64_t)PGSIZE << order) / sizeof(uint64_t);
+    for (uint64_t i = 0; i < n; i++) p[i] = 0x0101010101010101ULL;
+}
+#endif
+
+static void list_push(int order, struct run *r) {
+    struct run *head = &pmm.freelist[order];
+    r->next = head->next;
+    r->prev = head;
+    head->next->prev = r;
+    head->next = r;
+    pmm.nfree[order]++;
+}
+
+static void list_remove(int order, struct run *r) {
+    r->prev->next = r->next;
+    r->next->prev = r->prev;
+    pmm.nfree[order]--;
+}
 
-/* 初始化物理内存管理器 */
+static void buddy_free(void *pa, int order);
+
+/* 把 [p, to) 按能对齐的最大块释放进伙伴系统 */
+static void free_range(uint64_t p, uint64_t to) {
+    while (p + PGSIZE <= to) {
+        int order = PMM_MAX_ORDER;
+        while (order > 0 &&
+               ((pa2idx((void*)p) & ((1UL << order) - 1)) != 0 ||
+                p + (PGSIZE << order) > to)) {
+            order--;
+        }
+        buddy_free((void*)p, order);
+        p += PGSIZE << order;
+    }
+}
+
+/* 从未初始化区间切出一个最大阶块交给伙伴系统，区间耗尽返回 0 */
+static int lazy_refill(void) {
+    uint64_t blk = (uint64_t)PGSIZE << PMM_MAX_ORDER;
+    if (pmm.lazy_next + PGSIZE > PHYSTOP) return 0;
+    uint64_t to = pmm.lazy_next + blk;
+    if (to > PHYSTOP) to = PHYSTOP;
+    uint64_t from = pmm.lazy_next;
+    pmm.lazy_next = to;
+    free_range(from, to);
+    return 1;
+}
+
+/* 初始化物理内存管理器：只释放内核末尾到下一个最大块边界的零头，
+   其余内存用一个区间描述，O(1) 完成，分配时按需切块 */
 void pmm_init() {
+    uint64_t t0 = clint_read64(CLINT_MTIME);
     printf("pmm_init: initializing physical memory manager...\n");
-    
-    /* 将内核末尾到物理内存顶部的所有内存逐页释放 */
-    char *p = (char*)PGROUNDUP((uint64_t)end);
-    for (; (uint64_t)p + PGSIZE <= PHYSTOP; p += PGSIZE) {
-        free_page(p);
+
+    for (int o = 0; o <= PMM_MAX_ORDER; o++) {
+        pmm.freelist[o].next = pmm.freelist[o].prev = &pmm.freelist[o];
+        pmm.nfree[o] = 0;
     }
-    
-    printf("pmm_init: initialization complete. Free memory starts at %p\n", pmm.freelist);
+
+    uint64_t p = PGROUNDUP((uint64_t)end);
+    uint64_t blk = (uint64_t)PGSIZE << PMM_MAX_ORDER;
+    uint64_t head_end = (p + blk - 1) & ~(blk - 1);
+    if (head_end > PHYSTOP) head_end = PHYSTOP;
+    free_range(p, head_end);
+    pmm.lazy_next = head_end;
+
+    uint64_t t1 = clint_read64(CLINT_MTIME);
+    printf("pmm_init: initialization complete. Free memory starts at %p\n", (void*)p);
+    printf("pmm_init: took %lu mtime ticks (%lu us), lazy range %p-%p\n",
+           (unsigned long)(t1 - t0), (unsigned long)((t1 - t0) * 1000000 / MTIME_FREQ),
+           (void*)pmm.lazy_next, (void*)PHYSTOP);
+    pmm_dump();
 }
 
-/* 释放一个物理页，将其加入空闲链表头部 */
-void free_page(void *pa) {
-    struct run *r;
+/* 把已分配的块记到调用者名下（默认 PMM_TAG_OTHER） */
+static void account_alloc(void *pa, int order) {
+    uint64_t n = 1UL << order;
+    pages[pa2idx(pa)].tag = PMM_TAG_OTHER;
+    pmm.by_tag[PMM_TAG_OTHER] += n;
+    pmm.used += n;
+    if (pmm.used > pmm.peak) pmm.peak = pmm.used;
+}
 
-    if (((uint64_t)pa % PGSIZE) != 0 || (char*)pa < end || (uint64_t)pa >= PHYSTOP) {
-        printf("free_page: invalid physical address %p\n", pa);
+/* 释放 2^order 个连续物理页，引用计数降为 0 时才真正归还伙伴系统 */
+static void pmm_free(void *pa, int order) {
+    if (order < 0 || order > PMM_MAX_ORDER ||
+        ((uint64_t)pa % (PGSIZE << order)) != 0 || (char*)pa < end ||
+        (uint64_t)pa + (PGSIZE << order) > PHYSTOP) {
+        printf("free_pages: invalid physical address %p order %d\n", pa, order);
         return;
     }
 
-    /* 清空页面内容，便于调试 */
-    char *p = (char*)pa;
-    for(int i = 0; i < PGSIZE; i++) p[i] = 1;
+    uint64_t idx = pa2idx(pa);
+    if (pages[idx].flags & PG_FREE) {
+        printf("free_pages: double free %p\n", pa);
+        return;
+    }
+    /* 仍被其他页表共享：只减引用计数 */
+    if (pages[idx].refcnt > 1) {
+        pages[idx].refcnt--;
+        return;
+    }
+    pages[idx].refcnt = 0;
+    pmm.used -= 1UL << order;
+    pmm.by_tag[pages[idx].tag] -= 1UL << order;
 
-    r = (struct run*)pa;
-    r->next = pmm.freelist;
-    pmm.freelist = r;
+#ifdef PMM_DEBUG
+    page_poison(pa, order);
+#endif
+    buddy_free(pa, order);
 }
 
-/* 分配一个物理页，从空闲链表头部取出一个 */
-void* alloc_page(void) {
-    struct run *r = pmm.freelist;
+/* 把块放回伙伴系统，并与空闲伙伴逐级合并 */
+static void buddy_free(void *pa, int order) {
+    uint64_t idx = pa2idx(pa);
+    uint64_t first = pa2idx((void*)PGROUNDUP((uint64_t)end));
+    while (order < PMM_MAX_ORDER) {
+        uint64_t buddy = idx ^ (1UL << order);
+        if (buddy < first || buddy >= PMM_NPAGES) break;
+        if (!(pages[buddy].flags & PG_FREE) || pages[buddy].order != order) break;
+        /* 伙伴空闲：摘下并合并成更高一阶的块 */
+        list_remove(order, (struct run*)idx2pa(buddy));
+        pages[buddy].flags = 0;
+        idx &= ~(1UL << order);
+        order++;
+    }
 
-    if (r) {
-        pmm.freelist = r->next;
-    } else {
-        printf("alloc_page: out of memory\n");
-        return 0;
+    pages[idx].order = order;
+    pages[idx].flags = PG_FREE;
+    list_push(order, (struct run*)idx2pa(idx));
+}
+
+/* 从伙伴系统取 2^order 个连续物理页：取最小的足够大的块，多余部分拆分回低阶链表 */
+static void* buddy_alloc(int order) {
+    if (order < 0 || order > PMM_MAX_ORDER) return 0;
+
+    int o = order;
+    while (o <= PMM_MAX_ORDER && pmm.nfree[o] == 0) o++;
+    if (o > PMM_MAX_ORDER) {
+        /* 伙伴系统已空：从未初始化区间切出新块 */
+        if (!lazy_refill()) return 0;
+        o = order;
+        while (o <= PMM_MAX_ORDER && pmm.nfree[o] == 0) o++;
+        if (o > PMM_MAX_ORDER) return 0;
     }
 
-    /* 清空页面内容 */
-    char *p = (char*)r;
-    for(int i = 0; i < PGSIZE; i++) p[i] = 0;
+    struct run *r = pmm.freelist[o].next;
+    list_remove(o, r);
+    uint64_t idx = pa2idx(r);
+    pages[idx].flags = 0;
 
+    while (o > order) {
+        o--;
+        uint64_t buddy = idx + (1UL << o);
+        pages[buddy].order = o;
+        pages[buddy].flags = PG_FREE;
+        list_push(o, (struct run*)idx2pa(buddy));
+    }
+    pages[idx].order = order;
+    pages[idx].refcnt = 1;
     return (void*)r;
-}
\ No newline at end of file
+}
+
+/* 伙伴系统分配失败时先把冷的用户页压缩换出，再重试一次（需持有 pmm.lock）。
+   回收要分配压缩存储、扫描各进程页表，期间释放 pmm.lock；
+   reclaiming 标志让回收过程中（以及其他 hart 上）的分配失败直接返回 */
+static void* buddy_alloc_reclaim(int order) {
+    void *pa = buddy_alloc(order);
+    if (pa || pmm.reclaiming) return pa;
+    pmm.reclaiming = 1;
+    release(&pmm.lock);
+    vm_reclaim(ZRAM_RECLAIM_BATCH << order);
+    acquire(&pmm.lock);
+    pmm.reclaiming = 0;
+    return buddy_alloc(order);
+}
+
+/* 分配 2^order 个连续物理页，内容清零（清零在锁外进行） */
+void* alloc_pages(int order) {
+    acquire(&pmm.lock);
+    void *pa = buddy_alloc_reclaim(order);
+    if (pa) account_alloc(pa, order);
+    else pmm.failures++;
+    release(&pmm.lock);
+    if (!pa) {
+        printf("alloc_pages: out of memory (order %d)\n", order);
+        return 0;
+    }
+    page_zero(pa, order);
+    return pa;
+}
+
+/* 同 alloc_pages，但不清零（调用者会自行覆盖内容） */
+void* alloc_pages_nozero(int order) {
+    acquire(&pmm.lock);
+    void *pa = buddy_alloc_reclaim(order);
+    if (pa) account_alloc(pa, order);
+    else pmm.failures++;
+    release(&pmm.lock);
+    if (!pa) printf("alloc_pages: out of memory (order %d)\n", order);
+    return pa;
+}
+
+void free_pages(void *pa, int order) {
+    acquire(&pmm.lock);
+    pmm_free(pa, order);
+    release(&pmm.lock);
+}
+
+/* 释放一个物理页（0 阶） */
+void free_page(void *pa) {
+    free_pages(pa, 0);
+}
+
+/* 分配一个清零的物理页：优先使用预清零池 */
+void* alloc_page(void) {
+    void *pa = 0;
+    acquire(&pmm.lock);
+    if (pmm.nzero > 0) {
+        pa = pmm.zero_pool[--pmm.nzero];
+        account_alloc(pa, 0);
+    }
+    release(&pmm.lock);
+    return pa ? pa : alloc_pages(0);
+}
+
+/* 分配一个不清零的物理页，供会完整覆盖页面内容的调用者使用 */
+void* alloc_page_nozero(void) {
+    acquire(&pmm.lock);
+    void *pa = buddy_alloc(0);
+    if (!pa && pmm.nzero > 0) {
+        pa = pmm.zero_pool[--pmm.nzero];
+    }
+    if (!pa) {
+        pa = buddy_alloc_reclaim(0);
+    }
+    if (pa) account_alloc(pa, 0);
+    else pmm.failures++;
+    release(&pmm.lock);
+    if (!pa) printf("alloc_page: out of memory\n");
+    return pa;
+}
+
+/* 调度器空闲时调用：把预清零池补满 */
+void pmm_refill_zero_pool(void) {
+    for (;;) {
+        acquire(&pmm.lock);
+        void *pa = pmm.nzero < ZERO_POOL_SIZE ? buddy_alloc(0) : 0;
+        release(&pmm.lock);
+        if (!pa) break;
+        /* 清零时不持锁，其他 hart 可以继续分配 */
+        page_zero(pa, 0);
+        acquire(&pmm.lock);
+        if (pmm.nzero < ZERO_POOL_SIZE) pmm.zero_pool[pmm.nzero++] = pa;
+        else buddy_free(pa, 0);
+        release(&pmm.lock);
+    }
+}
+
+/* 增加一个已分配页的引用计数（写时复制 fork 共享物理页时使用） */
+void pmm_incref(void *pa) {
+    uint64_t idx = pa2idx(pa);
+    if ((uint64_t)pa < KERNBASE || idx >= PMM_NPAGES || (pages[idx].flags & PG_FREE)) {
+        printf("pmm_incref: invalid page %p\n", pa);
+        return;
+    }
+    acquire(&pmm.lock);
+    pages[idx].refcnt++;
+    release(&pmm.lock);
+}
+
+/* 返回物理页的引用计数 */
+int pmm_refcount(void *pa) {
+    uint64_t idx = pa2idx(pa);
+    if ((uint64_t)pa < KERNBASE || idx >= PMM_NPAGES) return 0;
+    return pages[idx].refcnt;
+}
+
+/* 把已分配块的统计从当前子系统转到 tag 名下 */
+void pmm_set_tag(void *pa, int tag) {
+    uint64_t idx = pa2idx(pa);
+    if ((uint64_t)pa < KERNBASE || idx >= PMM_NPAGES || tag < 0 || tag >= PMM_NTAGS ||
+        (pages[idx].flags & PG_FREE)) {
+        return;
+    }
+    uint64_t n = 1UL << pages[idx].order;
+    acquire(&pmm.lock);
+    pmm.by_tag[pages[idx].tag] -= n;
+    pmm.by_tag[tag] += n;
+    pages[idx].tag = tag;
+    release(&pmm.lock);
+}
+
+/* 读取内存统计 */
+void pmm_get_stats(struct pmm_stats *st) {
+    acquire(&pmm.lock);
+    uint64_t free = (PHYSTOP - pmm.lazy_next) / PGSIZE + pmm.nzero;
+    for (int o = 0; o <= PMM_MAX_ORDER; o++) free += pmm.nfree[o] << o;
+    st->total = free + pmm.used;
+    st->free = free;
+    st->used = pmm.used;
+    st->peak = pmm.peak;
+    st->failures = pmm.failures;
+    for (int t = 0; t < PMM_NTAGS; t++) st->by_tag[t] = pmm.by_tag[t];
+    release(&pmm.lock);
+}
+
+/* 打印内存统计：总量/空闲/已用/峰值/失败次数及各子系统占用页数 */
+void meminfo_dump(void) {
+    struct pmm_stats st;
+    pmm_get_stats(&st);
+    printf("meminfo: total=%lu free=%lu used=%lu peak=%lu failures=%lu (pages)\n",
+           (unsigned long)st.total, (unsigned long)st.free, (unsigned long)st.used,
+           (unsigned long)st.peak, (unsigned long)st.failures);
+    printf("meminfo: by subsystem:");
+    for (int t = 0; t < PMM_NTAGS; t++) {
+        printf(" %s=%lu", tag_names[t], (unsigned long)st.by_tag[t]);
+    }
+    printf("\n");
+    zram_dump();
+}
+
+/* 打印每一阶的空闲块数，用于观察碎片情况 */
+void pmm_dump(void) {
+    uint64_t total = 0;
+    printf("pmm: free blocks per order:");
+    for (int o = 0; o <= PMM_MAX_ORDER; o++) {
+        printf(" %d:%lu", o, (unsigned long)pmm.nfree[o]);
+        total += pmm.nfree[o] << o;
+    }
+    total += (PHYSTOP - pmm.lazy_next) / PGSIZE;
+    printf("\npmm: free pages=%lu (lazy %lu, zero pool %d)\n", (unsigned long)total,
+           (unsigned long)((PHYSTOP - pmm.lazy_next) / PGSIZE), pmm.nzero);
+}
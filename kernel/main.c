@@ -1,7 +1,10 @@
 // filepath: /home/bri/Desktop/riscv-os/riscv_Operating_System/kernel/main.c
 #include "printf.h"
 #include "pmm.h"
+#include "slab.h"
 #include "vmm.h"
+#include "zram.h"
+#include "memlayout.h"
 #include "uart.h"
 #include "trap.h"
 #include "proc.h"   /* 新增：process APIs */
@@ -10,6 +13,7 @@
 /* 新增：demo 初始化函数原型（定义在 kernel/fs_demo.c）*/
 void syscall_demo_init(void);
 void fs_demo_init(void);   /* 新增 */
+void bench_init(void);     /* kernel/bench.c，仅基准测试镜像 */
 
 static void cpu_task(void) {
     for (int i = 0; i < 5; i++) {
@@ -50,9 +54,110 @@ void test_physical_memory(void) {
     void *p3 = alloc_page();
     printf("Allocated page 3 at %p (should be same as last freed page).\n", p3);
     free_page(p3);
+
+    /* 伙伴分配：多页连续块应按块大小对齐，释放后与伙伴合并 */
+    void *b1 = alloc_pages(3);
+    void *b2 = alloc_pages(0);
+    printf("Allocated order-3 block at %p, order-0 page at %p\n", b1, b2);
+    if (b1 == 0 || ((unsigned long)b1 % (PGSIZE << 3)) != 0) {
+        printf_color(COLOR_RED, "Order-3 block misaligned!\n");
+    }
+    free_pages(b1, 3);
+    free_page(b2);
+    pmm_dump();
     printf("PMM test complete.\n");
 }
 
+/* 写时复制测试：复制页表后两边共享同一物理页，写缺页后各自独立 */
+void test_cow_fork(void) {
+    printf("\n=== Testing copy-on-write page tables ===\n");
+    pagetable_t parent = uvm_create();
+    pagetable_t child = uvm_create();
+    if (!parent || !child || uvm_alloc(parent, 0, PGSIZE) == 0) {
+        printf_color(COLOR_RED, "COW test setup failed!\n");
+        return;
+    }
+    pte_t *pp = walk_leaf(parent, USERBASE, 0);
+    *(uint64_t*)PTE2PA(*pp) = 0x1234;
+
+    uvm_cow_copy(parent, 0, child, USERBASE, USERBASE + PGSIZE);
+    pte_t *cp = walk_leaf(child, USERBASE, 0);
+    printf("shared: parent pa=%p child pa=%p refcnt=%d\n",
+           (void*)PTE2PA(*pp), (void*)PTE2PA(*cp), pmm_refcount((void*)PTE2PA(*pp)));
+
+    cow_fault(child, 0, USERBASE);
+    printf("after child write fault: child pa=%p value=%lx writable=%d\n",
+           (void*)PTE2PA(*cp), (unsigned long)*(uint64_t*)PTE2PA(*cp), (*cp & PTE_W) != 0);
+    cow_fault(parent, 0, USERBASE);
+    printf("after parent write fault: parent refcnt=%d writable=%d\n",
+           pmm_refcount((void*)PTE2PA(*pp)), (*pp & PTE_W) != 0);
+
+    uvm_free(child);
+    uvm_free(parent);
+    printf("COW test complete.\n");
+}
+
+/* 压缩交换测试：可压缩页存入再取回内容应一致，同值页不占压缩空间，随机内容的页应被拒绝 */
+void test_zram(void) {
+    printf("\n=== Testing zram ===\n");
+    char *src = (char*)alloc_page();
+    char *dst = (char*)alloc_page_nozero();
+    for (int i = 0; i < PGSIZE; i++) src[i] = "page fault "[i % 11] + (i / 512);
+    int slot = zram_store(src);
+    if (slot < 0 || zram_load(slot, dst) < 0) {
+        printf_color(COLOR_RED, "zram store/load failed!\n");
+    } else {
+        for (int i = 0; i < PGSIZE; i++) {
+            if (src[i] != dst[i]) {
+                printf_color(COLOR_RED, "zram mismatch at %d\n", i);
+                break;
+            }
+        }
+        zram_free(slot);
+    }
+    uint64_t *w = (uint64_t*)src;
+    for (int i = 0; i < PGSIZE / 8; i++) w[i] = 0x5a5a5a5a5a5a5a5aULL;
+    slot = zram_store(src);
+    if (slot < 0 || zram_load(slot, dst) < 0 || ((uint64_t*)dst)[PGSIZE / 8 - 1] != w[0]) {
+        printf_color(COLOR_RED, "zram same-filled page failed!\n");
+    } else {
+        printf("same-filled page stored in slot %d\n", slot);
+    }
+    zram_dump();
+    if (slot >= 0) zram_free(slot);
+    uint64_t x = 88172645463325252ULL;
+    for (int i = 0; i < PGSIZE / 8; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        w[i] = x;
+    }
+    slot = zram_store(src);
+    printf("random page store returned %d (should be -1, incompressible)\n", slot);
+    if (slot >= 0) zram_free(slot);
+    zram_dump();
+    free_page(src);
+    free_page(dst);
+    printf("zram test complete.\n");
+}
+
+/* 副 hart 入口（entry.S 在 smp_started 置位后调用）：
+   全局数据结构已由 hart 0 初始化好，这里只做本 hart 的设置 */
+void mpmain(void) {
+    kvminithart();
+    trap_inithart();
+    printf("hart %d started\n", cpuid());
+    scheduler();
+}
+
+/* 放行其他 hart，然后进入调度器（不会返回） */
+static void start_scheduling(void) {
+    extern volatile int smp_started;
+    __sync_synchronize();
+    smp_started = 1;
+    scheduler();
+}
+
 void main(void) {
     /* 初始化UART和printf */
     uart_init();
@@ -62,6 +167,7 @@ void main(void) {
 
     /* 初始化物理内存管理器 */
     pmm_init();
+    kmem_init();
     
 #if 0
     /* 原来实验测试注释掉 */
@@ -77,12 +183,25 @@ void main(void) {
     printf_color(COLOR_GREEN, "Paging enabled successfully!\n");
     printf("Now running on virtual addresses.\n");
 
+#ifndef BENCH
+    test_cow_fork();
+    test_zram();
+#endif
+
 
 
     /* 启用中断与时钟（为调度器准备） */
     trap_init();
     printf("Timer interrupt initialized. ticks=%lu\n", (unsigned long)ticks);
 
+#ifdef BENCH
+    /* 基准测试镜像：跳过各实验演示，只运行基准测试进程 */
+    proc_init();
+    fs_init();
+    bench_init();
+    start_scheduling();
+#endif
+
     { 
         /* -- 新增：实验四 中断测试（在进入调度器前的空闲打印） */
         printf("System ready. Entering idle loop...\n");
@@ -108,6 +227,7 @@ void main(void) {
         printf_color(COLOR_YELLOW, "\nExperiment 5: Process management & scheduling - START\n");
 
         /* 创建测试进程 */
+        proc_init();
         int pid1 = create_process(cpu_task);
         int pid2 = create_process(tcp_task);
         printf("Created processes pid=%d pid=%d\n", pid1, pid2);
@@ -120,7 +240,7 @@ void main(void) {
         fs_demo_init();   /* 新增：在不改变前面输出的前提下添加文件系统演示 */
 
         /* 进入调度器（不会返回） */
-        scheduler();
+        start_scheduling();
     }
 
     /* 不会走到这里 */
@@ -1,6 +1,10 @@
 #include "printf.h"
+#include "spinlock.h"
 #include <stdarg.h>
 
+/* 多个 hart 同时输出时保证每次 printf 的内容不被打散 */
+static struct spinlock pr_lock = SPINLOCK_INIT("pr");
+
 /* 字符串长度计算 */
 static int strlen(const char *s) {
     int len = 0;
@@ -191,9 +195,11 @@ int printf(const char *fmt, ...) {
     va_list ap;
     int result;
 
+    acquire(&pr_lock);
     va_start(ap, fmt);
     result = vprintf(fmt, ap);
     va_end(ap);
+    release(&pr_lock);
 
     return result;
 }
@@ -211,6 +217,7 @@ void printf_color(int color, const char *fmt, ...) {
 
     /* 设置颜色 */
     print_number(color_code, 30 + color, 10, 0);
+    acquire(&pr_lock);
     console_puts("\033[");
     console_puts(color_code);
     console_puts("m");
@@ -222,4 +229,5 @@ void printf_color(int color, const char *fmt, ...) {
 
     /* 重置颜色 */
     console_puts("\033[0m");
+    release(&pr_lock);
 }
\ No newline at end of file
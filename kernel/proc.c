@@ -2,17 +2,270 @@
 #include "printf.h"
 #include "pmm.h"
 #include "proc.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "vmm.h"
 #include "trap.h"   /* for get_time() if needed */
+#include "timer.h"
+#include "ring.h"
+#include "vdso.h"
+#include "syscall.h"
 
-struct proc proc[NPROC];
+/* 进程槽位表：struct proc 本身从 proc_cache 按需分配 */
+struct proc *proc[NPROC];
+static struct kmem_cache *proc_cache;
+
+/* 每个 hart 的当前进程和调度器上下文 */
+struct cpu cpus[NCPU];
+
+/* proc_lock 保护 proc[]、nextpid 以及各进程的 state/chan。
+   进程切换时由切出方持有、切入方释放（scheduler 与 sched 之间传递） */
+struct spinlock proc_lock = SPINLOCK_INIT("proc");
 
 static int nextpid = 1;
-static struct proc *curproc = 0;
-static struct context scheduler_context;
+
+/* 就绪队列：RUNNABLE 进程按 vruntime 组成的最小堆，堆顶是目前最"欠"CPU 的进程。
+   出队/入队 O(log n)，由 proc_lock 保护，各 hart 共用 */
+static struct {
+    struct proc *heap[NPROC];
+    int n;
+    uint64 min_vruntime;      /* 单调不减：新建/唤醒的进程以此为基准，避免积攒过多的补偿 */
+} runq;
+
+/* pid 散列表，由 proc_lock 保护 */
+static struct proc *pidhash[NPIDHASH];
+
+/* 等待队列：同一桶内的睡眠者按入睡顺序排成双向链表（不同 chan 可能共桶），由 proc_lock 保护 */
+static struct waitq {
+    struct proc *head;
+    struct proc *tail;
+    uint64 nsleep;            /* 累计入睡次数 */
+    uint64 nwake;             /* 累计被唤醒的进程数 */
+    uint64 nscan;             /* wakeup 累计检查的进程数（含同桶其他 chan） */
+} waitq[NWAITHASH];
+
+static void sleep_locked(struct proc *p, void *chan);
+static void wakeup_locked(void *chan, int all);
+
+static struct waitq* waitq_of(void *chan) {
+    uint64 h = ((uint64)chan >> 3) * 0x9E3779B97F4A7C15ULL;
+    return &waitq[(h >> 32) & (NWAITHASH - 1)];
+}
+
+/* nice -20..19 到权重的映射（与 Linux CFS 相同：相邻两级相差约 1.25 倍） */
+static const uint32_t nice_to_weight[NICE_MAX - NICE_MIN + 1] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+/* 睡眠后被唤醒的进程最多领先 min_vruntime 这么多（mtime 计数，半个时间片） */
+#define SCHED_WAKEUP_CREDIT (TICK_INTERVAL * SCHED_QUANTUM / 2)
+
+static void runq_set(int i, struct proc *p) {
+    runq.heap[i] = p;
+    p->rq_index = i;
+}
+
+static void runq_sift_up(int i) {
+    struct proc *p = runq.heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (runq.heap[parent]->vruntime <= p->vruntime) break;
+        runq_set(i, runq.heap[parent]);
+        i = parent;
+    }
+    runq_set(i, p);
+}
+
+static void runq_sift_down(int i) {
+    struct proc *p = runq.heap[i];
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= runq.n) break;
+        if (c + 1 < runq.n && runq.heap[c + 1]->vruntime < runq.heap[c]->vruntime) c++;
+        if (p->vruntime <= runq.heap[c]->vruntime) break;
+        runq_set(i, runq.heap[c]);
+        i = c;
+    }
+    runq_set(i, p);
+}
+
+static void runq_push(struct proc *p) {
+    runq_set(runq.n++, p);
+    runq_sift_up(p->rq_index);
+}
+
+/* 有 hart 在无节拍空闲中：叫醒一个来取就绪进程（需持有 proc_lock） */
+static void kick_idle(void) {
+    for (int i = 0; i < NCPU; i++) {
+        if (cpus[i].idle && i != cpuid()) {
+            cpus[i].idle = 0;
+            ipi_send(i);
+            break;
+        }
+    }
+}
+
+static struct proc* runq_pop(void) {
+    if (runq.n == 0) return 0;
+    struct proc *p = runq.heap[0];
+    if (--runq.n > 0) {
+        runq_set(0, runq.heap[runq.n]);
+        runq_sift_down(0);
+    }
+    p->rq_index = -1;
+    if (p->vruntime > runq.min_vruntime) runq.min_vruntime = p->vruntime;
+    return p;
+}
+
+/* 把本次运行的实际时间按权重折算进 vruntime */
+static void update_vruntime(struct proc *p) {
+    uint64 now = get_time();
+    uint64 delta = now - p->exec_start;
+    p->vruntime += delta * NICE_0_WEIGHT / p->weight;
+    p->exec_start = now;
+}
+
+static void waitq_remove(struct waitq *q, struct proc *p) {
+    if (p->wq_prev) p->wq_prev->wq_next = p->wq_next;
+    else q->head = p->wq_next;
+    if (p->wq_next) p->wq_next->wq_prev = p->wq_prev;
+    else q->tail = p->wq_prev;
+    p->wq_next = p->wq_prev = 0;
+}
+
+void proc_setrunnable(struct proc *p) {
+    if (p->state == SLEEPING) {
+        /* 被 wakeup 或 kill 叫醒：从所在的等待队列摘除 */
+        struct waitq *q = waitq_of(p->chan);
+        waitq_remove(q, p);
+        q->nwake++;
+        p->chan = 0;
+    }
+    if (p->state == USED) {
+        /* 新进程从当前最小值起步，不会因为 vruntime 为 0 而长期独占 CPU */
+        p->vruntime = runq.min_vruntime;
+    } else if (p->state == SLEEPING && p->vruntime + SCHED_WAKEUP_CREDIT < runq.min_vruntime) {
+        /* 睡眠期间不累计补偿，只给一点领先量让交互式进程唤醒后尽快运行 */
+        p->vruntime = runq.min_vruntime - SCHED_WAKEUP_CREDIT;
+    }
+    p->state = RUNNABLE;
+    runq_push(p);
+    kick_idle();
+}
+
+struct proc* proc_find(int pid) {
+    for (struct proc *p = pidhash[pid & (NPIDHASH - 1)]; p; p = p->pid_next) {
+        if (p->pid == pid) return p;
+    }
+    return 0;
+}
+
+/* 内核栈：KSTACK_PAGES 个物理连续页。内核运行在 M 态、不经过页表，无法在栈下方放未映射的保护页，
+   改为把栈底 KSTACK_GUARD 字节当作保护区：整个栈预先填满金丝雀值，
+   每次进程切回调度器时检查保护区是否被改写（溢出），退出时从栈底向上扫描得到最高水位。
+   回收的栈放进缓存，复用时只需重新填充上次用到的部分 */
+#define KSTACK_GUARD     256
+#define KSTACK_CANARY    0x57ACC0DE57ACC0DEULL
+#define KSTACK_CACHE_MAX 8
+
+static struct {
+    void *stack[KSTACK_CACHE_MAX];
+    uint32_t used[KSTACK_CACHE_MAX];   /* 该栈上次的最高水位：复用时只需重新填充这一段 */
+    int n;
+    uint64 hits;              /* 从缓存复用的次数 */
+    uint64 misses;            /* 向伙伴系统新分配的次数 */
+    uint32_t max_used;        /* 所有已退出进程中最深的栈使用量 */
+    struct spinlock lock;
+} kstacks = { .lock = SPINLOCK_INIT("kstack") };
+
+static int kstack_order(void) {
+    int order = 0;
+    while ((1 << order) < KSTACK_PAGES) order++;
+    return order;
+}
+
+/* 把栈顶往下 len 字节填成金丝雀 */
+static void kstack_paint(void *stack, uint32_t len) {
+    uint64 *w = (uint64*)((char*)stack + KSTACK_SIZE - len);
+    uint64 *e = (uint64*)((char*)stack + KSTACK_SIZE);
+    while (w < e) *w++ = KSTACK_CANARY;
+}
+
+static void* kstack_alloc(void) {
+    acquire(&kstacks.lock);
+    if (kstacks.n > 0) {
+        kstacks.n--;
+        void *s = kstacks.stack[kstacks.n];
+        uint32_t used = kstacks.used[kstacks.n];
+        kstacks.hits++;
+        release(&kstacks.lock);
+        kstack_paint(s, used);
+        return s;
+    }
+    kstacks.misses++;
+    release(&kstacks.lock);
+    void *s = alloc_pages_nozero(kstack_order());
+    if (s == 0) return 0;
+    pmm_set_tag(s, PMM_TAG_KSTACK);
+    kstack_paint(s, KSTACK_SIZE);
+    return s;
+}
+
+/* 从栈底向上找第一个被改写的字，返回栈的最高水位（字节） */
+static uint32_t kstack_usage(void *stack) {
+    uint64 *w = (uint64*)stack;
+    uint64 *e = (uint64*)((char*)stack + KSTACK_SIZE);
+    while (w < e && *w == KSTACK_CANARY) w++;
+    return (uint32_t)((char*)e - (char*)w);
+}
+
+static void kstack_free(void *stack) {
+    uint32_t used = kstack_usage(stack);
+    acquire(&kstacks.lock);
+    if (used > kstacks.max_used) kstacks.max_used = used;
+    if (kstacks.n < KSTACK_CACHE_MAX) {
+        kstacks.stack[kstacks.n] = stack;
+        kstacks.used[kstacks.n] = used;
+        kstacks.n++;
+        stack = 0;
+    }
+    release(&kstacks.lock);
+    if (stack) free_pages(stack, kstack_order());
+}
+
+/* 保护区被改写说明栈已经溢出，相邻内存可能已损坏，只能停机 */
+static void kstack_check(struct proc *p) {
+    uint64 *w = (uint64*)p->kstack;
+    for (int i = 0; i < KSTACK_GUARD / 8; i++) {
+        if (w[i] != KSTACK_CANARY) {
+            printf("kstack: pid=%d overflowed its %d-byte kernel stack\n", p->pid, KSTACK_SIZE);
+            for (;;) __asm__ volatile("wfi");
+        }
+    }
+}
+
+void kstack_dump(void) {
+    acquire(&kstacks.lock);
+    printf("kstack: size=%d bytes cached=%d hits=%lu misses=%lu max used=%d bytes\n",
+           KSTACK_SIZE, kstacks.n, (unsigned long)kstacks.hits, (unsigned long)kstacks.misses,
+           kstacks.max_used);
+    release(&kstacks.lock);
+}
 
 /* 内部：启动新进程的 trampoline（在进程上下文中运行）*/
 static void proc_trampoline(void) {
     struct proc *p = myproc();
+    /* 之后的陷阱保存到本进程的 trapframe */
+    w_mscratch((uint64)&p->tf);
+    /* 调度器切换过来时持有 proc_lock；释放后恢复调度器开着的中断 */
+    release(&proc_lock);
     if (p && p->entry) {
         p->entry();
     }
@@ -20,42 +273,97 @@ static void proc_trampoline(void) {
     exit_process(0);
 }
 
-/* 返回当前进程指针（简单全局实现） */
+/* 创建 struct proc 对象缓存（需在 kmem_init 之后、创建进程之前调用） */
+void proc_init(void) {
+    proc_cache = kmem_cache_create("proc", sizeof(struct proc), CACHE_LINE_SIZE);
+}
+
+/* 当前 hart 编号。M 态可以直接读 mhartid */
+int cpuid(void) {
+    return (int)r_mhartid();
+}
+
+/* 当前 hart 的 cpu 结构。进程可能被抢占后迁移到其他 hart，调用者应关中断 */
+struct cpu* mycpu(void) {
+    return &cpus[cpuid()];
+}
+
+/* 返回当前进程指针 */
 struct proc* myproc(void) {
-    return curproc;
+    push_off();
+    struct proc *p = mycpu()->proc;
+    pop_off();
+    return p;
 }
 
 /* 分配空闲进程结构（导出供fork使用） */
 struct proc* allocproc(void) {
+    /* 先分配内存再拿 proc_lock：分配可能触发 vm_reclaim，它只 try-acquire proc_lock */
+    struct proc *p = (struct proc*)kmem_cache_alloc(proc_cache);
+    if (!p) return 0;
+    /* 内核栈内容无需清零，swtch 只依赖下面设置的上下文 */
+    p->kstack = kstack_alloc();
+    p->kstack_used = 0;
+    if (!p->kstack) {
+        kmem_cache_free(proc_cache, p);
+        return 0;
+    }
+    p->pagetable = uvm_create();
+    if (!p->pagetable) {
+        kstack_free(p->kstack);
+        kmem_cache_free(proc_cache, p);
+        return 0;
+    }
+    p->state = USED;
+    initlock(&p->vmlock, "vm");
+    proc_vm_init(p);
+    p->asid = 0;
+    p->asid_gen = 0;
+    p->rq_index = -1;
+    p->wq_next = p->wq_prev = 0;
+    p->ring = 0;
+    p->parent_proc = 0;
+    p->children = 0;
+    p->sibling_next = p->sibling_prev = 0;
+    p->nice = 0;
+    p->weight = NICE_0_WEIGHT;
+    p->vruntime = 0;
+    p->exec_start = 0;
+    /* 设置初始上下文：栈顶 */
+    uint64 kstack_top = (uint64)p->kstack + KSTACK_SIZE;
+    for (int k = 0; k < sizeof(struct context)/8; k++) {
+        ((uint64*)&p->context)[k] = 0;
+    }
+    p->context.sp = kstack_top;
+    p->context.ra = (uint64)proc_trampoline;
+    p->entry = 0;
+    p->chan = 0;
+    p->killed = 0;
+    p->xstate = 0;
+    p->parent = 0;
+    p->slice = 0;
+    p->preempt_count = 0;
+    p->need_resched = 0;
+    p->nvcsw = 0;
+    p->nivcsw = 0;
+
+    /* 持锁只占槽位和分配 pid */
+    acquire(&proc_lock);
     for (int i = 0; i < NPROC; i++) {
-        if (proc[i].state == UNUSED) {
-            struct proc *p = &proc[i];
-            p->state = USED;
+        if (proc[i] == 0) {
+            p->slot = i;
             p->pid = nextpid++;
-            p->kstack = alloc_page();
-            if (!p->kstack) {
-                p->state = UNUSED;
-                return 0;
-            }
-            /* 清栈并设置初始上下文 */
-            char *sp = (char*)p->kstack;
-            for (int j = 0; j < PGSIZE; j++) sp[j] = 0;
-            /* 栈顶 */
-            uint64 kstack_top = (uint64)p->kstack + PGSIZE;
-            for (int k = 0; k < sizeof(struct context)/8; k++) {
-                ((uint64*)&p->context)[k] = 0;
-            }
-            p->context.sp = kstack_top;
-            p->context.ra = (uint64)proc_trampoline;
-            p->entry = 0;
-            p->chan = 0;
-            p->killed = 0;
-            p->xstate = 0;
-            p->parent = 0;
-            p->fork_ret = -1;  /* 初始化为-1，表示未fork */
+            p->pid_next = pidhash[p->pid & (NPIDHASH - 1)];
+            pidhash[p->pid & (NPIDHASH - 1)] = p;
+            proc[i] = p;
+            release(&proc_lock);
             return p;
         }
     }
+    release(&proc_lock);
+    uvm_free(p->pagetable);
+    kstack_free(p->kstack);
+    kmem_cache_free(proc_cache, p);
     return 0;
 }
 
@@ -64,23 +372,125 @@ int create_process(void (*entry)(void)) {
     struct proc *p = allocproc();
     if (!p) return -1;
     p->entry = entry;
-    p->state = RUNNABLE;
+    acquire(&proc_lock);
+    proc_setrunnable(p);
+    release(&proc_lock);
     return p->pid;
 }
 
-/* 释放进程资源（假设已为 ZOMBIE） */
-static void freeproc(struct proc *p) {
+/* 从槽位表和 pid 散列摘除（需持有 proc_lock，进程不在就绪队列中），之后其他 hart 不会再看到该进程 */
+static void proc_unlink(struct proc *p) {
+    struct proc **pp = &pidhash[p->pid & (NPIDHASH - 1)];
+    while (*pp != p) pp = &(*pp)->pid_next;
+    *pp = p->pid_next;
+    p->state = UNUSED;
+    proc[p->slot] = 0;
+}
+
+/* 释放已摘除进程的资源，进程结构归还 proc_cache */
+static void proc_free(struct proc *p) {
     if (p->kstack) {
-        free_page(p->kstack);
+        kstack_free(p->kstack);
         p->kstack = 0;
     }
-    p->state = UNUSED;
-    p->pid = 0;
-    p->entry = 0;
-    p->chan = 0;
-    p->killed = 0;
-    p->parent = 0;
-    p->fork_ret = -1;
+    ring_free(p);
+    proc_vm_free(p);
+    uvm_free(p->pagetable);
+    p->pagetable = 0;
+    p->sz = 0;
+    kmem_cache_free(proc_cache, p);
+}
+
+void proc_add_child(struct proc *parent, struct proc *child) {
+    child->parent = parent->pid;
+    child->parent_proc = parent;
+    child->sibling_prev = 0;
+    child->sibling_next = parent->children;
+    if (parent->children) parent->children->sibling_prev = child;
+    parent->children = child;
+}
+
+/* 从父进程的子进程链表摘除（需持有 proc_lock） */
+static void child_unlink(struct proc *c) {
+    struct proc *parent = c->parent_proc;
+    if (c->sibling_prev) c->sibling_prev->sibling_next = c->sibling_next;
+    else parent->children = c->sibling_next;
+    if (c->sibling_next) c->sibling_next->sibling_prev = c->sibling_prev;
+    c->sibling_next = c->sibling_prev = 0;
+    c->parent_proc = 0;
+}
+
+/* 摘除已脱离父进程的僵尸 p 及其留下的僵尸子进程（需持有 proc_lock），
+   串到 *list 上，由调用者释放锁后交给 reap_free */
+static void reap_collect(struct proc *p, struct proc **list) {
+    while (p->children) {
+        struct proc *c = p->children;
+        child_unlink(c);
+        reap_collect(c, list);
+    }
+    proc_unlink(p);
+    p->sibling_next = *list;
+    *list = p;
+}
+
+static void reap_free(struct proc *list) {
+    while (list) {
+        struct proc *next = list->sibling_next;
+        proc_free(list);
+        list = next;
+    }
+}
+
+/* 释放进程资源（假设已为 ZOMBIE 或尚未运行） */
+void freeproc(struct proc *p) {
+    acquire(&proc_lock);
+    proc_unlink(p);
+    release(&proc_lock);
+    proc_free(p);
+}
+
+/* 切换回本 hart 的调度器。调用者持有 proc_lock（且不持有其他锁）并已设置好 p->state；
+   返回时恢复本进程的 mscratch（是否正处于陷阱处理中）和中断使能状态 */
+static void sched(void) {
+    struct cpu *c = mycpu();
+    struct proc *p = c->proc;
+    if (!holding(&proc_lock) || c->noff != 1) {
+        printf("sched: pid=%d switching with locks held\n", p ? p->pid : -1);
+        for (;;) __asm__ volatile("wfi");
+    }
+    int intena = c->intena;
+    uint64 scratch = r_mscratch();
+    swtch(&p->context, &c->context);
+    /* 可能已经在另一个 hart 上恢复运行 */
+    w_mscratch(scratch);
+    mycpu()->intena = intena;
+}
+
+/* 把 p 变为僵尸（需持有 proc_lock）：仍在运行的子进程脱离 p，之后退出时由调度器直接回收；
+   已是僵尸的子进程留在链表上，随 p 一起回收。有父进程时唤醒其 waitpid，由父进程回收 p */
+static void proc_exit_locked(struct proc *p, int status) {
+    struct proc *next;
+    for (struct proc *c = p->children; c; c = next) {
+        next = c->sibling_next;
+        if (c->state != ZOMBIE) {
+            child_unlink(c);
+            c->parent = 0;
+        }
+    }
+    p->xstate = status;
+    p->state = ZOMBIE;
+    /* 只有父进程会睡在它自己上（waitpid），唤醒一个即可 */
+    if (p->parent_proc) wakeup_locked(p->parent_proc, 0);
+}
+
+/* 调度器中回收没有父进程的僵尸（需持有 proc_lock，返回时仍持有） */
+static void reap_orphan(struct proc *p) {
+    if (p->state != ZOMBIE || p->parent_proc) return;
+    struct proc *list = 0;
+    reap_collect(p, &list);
+    release(&proc_lock);
+    reap_free(list);
+    acquire(&proc_lock);
 }
 
 /* 退出当前进程（不会返回） */
@@ -91,101 +501,289 @@ void exit_process(int status) {
         printf("exit_process called outside process\n");
         for(;;) __asm__ volatile("wfi");
     }
-    p->xstate = status;
-    p->state = ZOMBIE;
-    /* 切换回调度器 */
-    yield();
+    p->kstack_used = kstack_usage(p->kstack);
+#ifndef BENCH
+    /* 基准测试镜像中不打印：串口输出会计入创建/回收进程的耗时 */
+    if (p->nfault_anon || p->nfault_file || p->nfault_cow || p->nfault_swap) {
+        printf("exit: pid=%d page faults anon=%d file=%d cow=%d swap=%d\n",
+               p->pid, p->nfault_anon, p->nfault_file, p->nfault_cow, p->nfault_swap);
+    }
+#endif
+    /* 切换次数和内核栈水位只在打开 exit 跟踪点（trace(1 << SYS_exit)）时打印 */
+    if ((syscall_trace_mask >> SYS_exit) & 1) {
+        printf("exit: pid=%d context switches voluntary=%d involuntary=%d kstack used=%d/%d bytes\n",
+               p->pid, p->nvcsw, p->nivcsw, p->kstack_used, KSTACK_SIZE);
+    }
+    acquire(&proc_lock);
+    proc_exit_locked(p, status);
+    /* 直接切换回调度器（不能走 yield，否则状态会被改回 RUNNABLE） */
+    sched();
     /* 不会返回 */
     for(;;) { __asm__ volatile("wfi"); }
 }
 
-/* 等待子进程（只等待自己的子进程） */
-int wait_process(int *status) {
+/* 等待子进程退出并回收。pid 为 -1 时等待任意子进程；
+   没有符合条件的子进程返回 -1，WNOHANG 且子进程都还在运行时返回 0。
+   子进程的 exit_process 会唤醒睡在父进程本身上的 waitpid */
+int waitpid(int pid, int *status, int options) {
     struct proc *p = myproc();
     if (!p) return -1;
-    
+
+    acquire(&proc_lock);
     for (;;) {
-        for (int i = 0; i < NPROC; i++) {
-            struct proc *child = &proc[i];
-            /* 只等待自己的子进程 */
-            if (child->state == ZOMBIE && child->parent == p->pid) {
-                int pid = child->pid;
-                if (status) *status = child->xstate;
-                freeproc(child);
-                return pid;
-            }
+        int found = 0;
+        for (struct proc *c = p->children; c; c = c->sibling_next) {
+            if (pid != -1 && c->pid != pid) continue;
+            found = 1;
+            if (c->state != ZOMBIE) continue;
+            int cpid = c->pid;
+            if (status) *status = c->xstate;
+            struct proc *list = 0;
+            child_unlink(c);
+            reap_collect(c, &list);
+            release(&proc_lock);
+            reap_free(list);
+            return cpid;
+        }
+        if (!found || p->killed) {
+            release(&proc_lock);
+            return -1;
+        }
+        if (options & WNOHANG) {
+            release(&proc_lock);
+            return 0;
         }
-        /* 没找到，主动放弃CPU并重试 */
-        yield();
+        sleep_locked(p, p);
     }
 }
 
+int wait_process(int *status) {
+    return waitpid(-1, status, 0);
+}
+
 /* 让出CPU，回到调度器 */
 void yield(void) {
     struct proc *p = myproc();
     if (!p) return;
-    p->state = RUNNABLE;
-    curproc = 0;
-    swtch(&p->context, &scheduler_context);
+    acquire(&proc_lock);
+    p->state = RUNNABLE;   /* 由调度器记账后重新入堆 */
+    p->nvcsw++;
+    sched();
+    release(&proc_lock);
 }
 
-/* sleep/wakeup（基于 chan 指针） */
-void sleep(void *chan) {
+/* 抢占当前进程；禁止抢占期间只做标记，由 preempt_enable 补上 */
+static void preempt(struct proc *p) {
+    acquire(&proc_lock);
+    if (p->state == RUNNING) {
+        if (p->preempt_count > 0) {
+            p->need_resched = 1;
+        } else {
+            p->need_resched = 0;
+            p->state = RUNNABLE;
+            p->nivcsw++;
+            sched();
+        }
+    }
+    release(&proc_lock);
+}
+
+/* 时钟中断中调用（中断已关）：当前进程用完 SCHED_QUANTUM 个节拍后被抢占 */
+void proc_tick(void) {
     struct proc *p = myproc();
-    if (!p) return;
+    if (p && ++p->slice >= SCHED_QUANTUM) {
+        preempt(p);
+    }
+    /* 被杀死的进程在自己的上下文中退出。系统调用期间中断是关的，
+       这里打断的只会是系统调用之外的代码，栈上没有内核登记的对象 */
+    if (p && p->killed) exit_process(-1);
+}
+
+/* 禁止/恢复抢占：保护进程上下文中修改共享数据的临界区，可嵌套。
+   不在进程上下文中（启动阶段、调度器）时本来就不会被抢占；持有自旋锁时中断已关，也不会被抢占 */
+void preempt_disable(void) {
+    struct proc *p = myproc();
+    if (p) p->preempt_count++;
+}
+
+void preempt_enable(void) {
+    struct proc *p = myproc();
+    if (p && --p->preempt_count == 0 && p->need_resched) {
+        preempt(p);
+    }
+}
+
+/* sleep/wakeup（基于 chan 指针）：睡眠者挂在 chan 散列到的等待队列尾部 */
+/* 调用者持有 proc_lock，返回时仍持有：检查条件和入睡之间不会漏掉唤醒 */
+static void sleep_locked(struct proc *p, void *chan) {
+    struct waitq *q = waitq_of(chan);
     p->chan = chan;
     p->state = SLEEPING;
-    curproc = 0;
-    swtch(&p->context, &scheduler_context);
+    p->wq_next = 0;
+    p->wq_prev = q->tail;
+    if (q->tail) q->tail->wq_next = p;
+    else q->head = p;
+    q->tail = p;
+    q->nsleep++;
+    p->nvcsw++;
+    sched();
+}
+
+void sleep(void *chan) {
+    struct proc *p = myproc();
+    if (!p) return;
+    acquire(&proc_lock);
+    sleep_locked(p, chan);
+    release(&proc_lock);
     /* 返回后，进程已经被唤醒或杀死 */
 }
 
-void wakeup(void *chan) {
-    for (int i = 0; i < NPROC; i++) {
-        struct proc *p = &proc[i];
-        if (p->state == SLEEPING && p->chan == chan) {
-            p->chan = 0;
-            p->state = RUNNABLE;
+/* chan 是睡眠者栈上的定时器，只有它一个等待者 */
+static void sleep_timer_fn(void *chan) {
+    wakeup_one(chan);
+}
+
+/* 在定时器上睡眠：到期回调在时钟中断中 wakeup，期间不占用任何调度 */
+int sleep_until(uint64 when) {
+    struct proc *p = myproc();
+    if (!p) return -1;
+    struct ktimer t;
+    timer_init(&t, sleep_timer_fn, &t);
+    int r = 0;
+    acquire(&proc_lock);
+    while (get_time() < when) {
+        if (p->killed) {
+            r = -1;
+            break;
         }
+        /* 持有 proc_lock 设置定时器：回调的 wakeup 要等本进程真正入睡后才能拿到锁 */
+        if (timer_add(&t, when) < 0) {
+            r = -1;
+            break;
+        }
+        sleep_locked(p, &t);
     }
+    release(&proc_lock);
+    /* 回调会拿 proc_lock，放锁后再取消；返回前确保回调不再访问栈上的 t */
+    timer_cancel(&t);
+    return r;
 }
 
-/* 简单调度器：轮转调度 */
+/* 唤醒 chan 上的睡眠者（需持有 proc_lock），all 为 0 时只唤醒最早入睡的一个 */
+static void wakeup_locked(void *chan, int all) {
+    struct waitq *q = waitq_of(chan);
+    struct proc *next;
+    for (struct proc *p = q->head; p; p = next) {
+        next = p->wq_next;
+        q->nscan++;
+        if (p->chan != chan) continue;
+        proc_setrunnable(p);
+        if (!all) break;
+    }
+}
+
+void wakeup(void *chan) {
+    acquire(&proc_lock);
+    wakeup_locked(chan, 1);
+    release(&proc_lock);
+}
+
+void wakeup_one(void *chan) {
+    acquire(&proc_lock);
+    wakeup_locked(chan, 0);
+    release(&proc_lock);
+}
+
+void wait_dump(void) {
+    acquire(&proc_lock);
+    printf("waitq: bucket sleeps wakeups scanned\n");
+    for (int i = 0; i < NWAITHASH; i++) {
+        struct waitq *q = &waitq[i];
+        if (q->nsleep == 0) continue;
+        printf("waitq: %d %lu %lu %lu%s\n", i, (unsigned long)q->nsleep, (unsigned long)q->nwake,
+               (unsigned long)q->nscan, q->head ? " (waiters)" : "");
+    }
+    release(&proc_lock);
+}
+
+/* 调度器：每个 hart 各跑一个，从就绪队列头取进程运行。
+   队列非空时连续调度，只有取不到进程时才补充预清零页池并 wfi 等待中断 */
 void scheduler(void) {
-    printf("scheduler: starting\n");
+    struct cpu *c = mycpu();
+    c->proc = 0;
+    printf("scheduler: hart %d starting\n", cpuid());
     for (;;) {
-        for (int i = 0; i < NPROC; i++) {
-            struct proc *p = &proc[i];
-            if (p->state != RUNNABLE) continue;
-            
-            // 检查进程是否被标记为killed
-            if (p->killed) {
-                printf("scheduler: process %d was killed\n", p->pid);
-                p->state = ZOMBIE;
-                p->xstate = -1;  // 被kill的进程退出码为-1
-                freeproc(p);
-                continue;
-            }
-            
-            curproc = p;
-            p->state = RUNNING;
-            /* 切换到进程上下文 */
-            swtch(&scheduler_context, &p->context);
-            
-            // 切换回来后再次检查killed标志
-            if (p->killed && p->state != ZOMBIE) {
-                printf("scheduler: process %d killed during execution\n", p->pid);
-                p->state = ZOMBIE;
-                p->xstate = -1;
+        /* 调度器本身可被时钟中断（不在进程上下文中，不会抢占），持锁切换期间关中断 */
+        intr_on();
+        acquire(&proc_lock);
+        struct proc *p = runq_pop();
+        if (p == 0) {
+            release(&proc_lock);
+            pmm_refill_zero_pool();
+            /* 关中断后再确认一次并进入无节拍空闲：之后别的 hart 入队会发 IPI，
+               挂起的中断即使全局关着也能让 wfi 返回，不会丢失唤醒 */
+            intr_off();
+            acquire(&proc_lock);
+            if (runq.n == 0) {
+                c->idle = 1;
+                release(&proc_lock);
+                timer_idle_enter();
+                __asm__ volatile("wfi");
+                timer_idle_exit();
+                c->idle = 0;
+            } else {
+                release(&proc_lock);
             }
-            
-            /* 返回后检查是否为 ZOMBIE 并回收 */
-            if (p->state == ZOMBIE) {
-                freeproc(p);
-            }
-            curproc = 0;
+            continue;
+        }
+
+        c->proc = p;
+        p->state = RUNNING;
+        p->slice = 0;
+        p->exec_start = get_time();
+        /* 切换到进程上下文（及其页表） */
+        vm_activate(p);
+        vdso_set_current(p->pid);
+        swtch(&c->context, &p->context);
+        vdso_set_current(0);
+        vm_activate(0);
+        /* 回到调度器：之后的陷阱在调度器栈上保存 */
+        w_mscratch(0);
+        c->proc = 0;
+        update_vruntime(p);
+        kstack_check(p);
+
+        /* 有父进程的僵尸留给父进程的 waitpid 回收，以便取得退出码 */
+        if (p->state == ZOMBIE) {
+            reap_orphan(p);
+            release(&proc_lock);
+            continue;
+        }
+        /* yield/抢占只改了状态：记账后按新的 vruntime 重新入堆 */
+        if (p->state == RUNNABLE) {
+            runq_push(p);
+            /* 本 hart 接下来只取走一个，多出来的交给空闲的 hart */
+            if (runq.n > 1) kick_idle();
+        } else if (p->killed && p->state == SLEEPING) {
+            /* 被杀死的进程不在这里替它退出：它栈上可能还挂着定时器等对象（如 sleep_until），
+               只能由它自己清理。运行中被杀死后又入睡的，唤醒它去自己的退出点（proc_tick、handle_syscall） */
+            proc_setrunnable(p);
         }
-        /* 若没有 RUNNABLE 进程，稍作等待 */
-        __asm__ volatile("wfi");
+        release(&proc_lock);
     }
-}
\ No newline at end of file
+}
+
+/* 修改 nice 值：只影响之后累计 vruntime 的速度，已在堆中的位置不变 */
+int proc_setnice(int pid, int nice) {
+    if (nice < NICE_MIN || nice > NICE_MAX) return -1;
+    acquire(&proc_lock);
+    struct proc *p = pid == 0 ? myproc() : proc_find(pid);
+    if (p == 0 || p->state == UNUSED || p->state == ZOMBIE) {
+        release(&proc_lock);
+        return -1;
+    }
+    p->nice = nice;
+    p->weight = nice_to_weight[nice - NICE_MIN];
+    release(&proc_lock);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "riscv.h"
+#include "memlayout.h"
+#include "printf.h"
+#include "pmm.h"
+#include "proc.h"
+#include "fs.h"
+#include "ring.h"
+#include "syscall.h"
+
+struct ring *ring_setup(struct proc *p) {
+    if (p == 0) return 0;
+    if (p->ring) return p->ring;
+    struct ring *r = (struct ring*)alloc_page();
+    if (r == 0) return 0;
+    r->entries = RING_ENTRIES;
+    p->ring = r;
+    return r;
+}
+
+/* 读、写、打开与对应的系统调用走同一套实现，缓冲区和路径名经 copyin/copyout 校验 */
+static int64_t ring_do(struct ring_sqe *e) {
+    switch (e->opcode) {
+    case RING_OP_NOP:
+        return 0;
+    case RING_OP_READ:
+        return do_read(e->fd, (void*)e->addr, e->len);
+    case RING_OP_WRITE:
+        return do_write(e->fd, (const char*)e->addr, e->len);
+    case RING_OP_OPEN:
+        return do_open((const char*)e->addr, e->op_flags);
+    case RING_OP_CLOSE:
+        return fs_close(e->fd);
+    default:
+        return -1;
+    }
+}
+
+long ring_enter(struct proc *p, uint32_t to_submit) {
+    struct ring *r = p ? p->ring : 0;
+    if (r == 0) return -1;
+    r->nenter++;
+    long done = 0;
+    uint32_t head = r->sq_head;
+    uint32_t tail = r->sq_tail;
+    /* 先读 tail 再读提交项 */
+    __sync_synchronize();
+    while (done < to_submit && head != tail) {
+        /* 完成队列满：留到进程消费后再执行 */
+        if (r->cq_tail - r->cq_head >= RING_ENTRIES) break;
+        /* 提交项先拷出来：进程可能在执行期间改写共享页 */
+        struct ring_sqe e = r->sq[head & (RING_ENTRIES - 1)];
+        struct ring_cqe *c = &r->cq[r->cq_tail & (RING_ENTRIES - 1)];
+        c->user_data = e.user_data;
+        c->res = ring_do(&e);
+        head++;
+        /* 完成项写好之后才推进 tail */
+        __sync_synchronize();
+        r->cq_tail++;
+        done++;
+    }
+    r->sq_head = head;
+    r->nops += done;
+    return done;
+}
+
+void ring_free(struct proc *p) {
+    if (p->ring) {
+        free_page(p->ring);
+        p->ring = 0;
+    }
+}
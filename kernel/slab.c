@@ -0,0 +1,224 @@
+#include "riscv.h"
+#include "printf.h"
+#include "pmm.h"
+#include "slab.h"
+#include "spinlock.h"
+
+/* slab 头位于每个 slab 页的起始处，空闲对象链表嵌入在空闲对象内部 */
+struct slab {
+    uint32_t magic;
+    uint32_t inuse;
+    struct kmem_cache *cache;
+    struct slab *next;
+    struct slab *prev;
+    void *freelist;
+};
+
+/* kmalloc 大块分配的头，同样位于块起始处，便于 kfree 区分 */
+struct large_hdr {
+    uint32_t magic;
+    uint32_t order;
+};
+
+#define SLAB_MAGIC  0x51AB51ABU
+#define LARGE_MAGIC 0x1A4E1A4EU
+
+/* 大块分配返回地址相对块起始的偏移，保证返回的指针缓存行对齐 */
+#define LARGE_HDR_SIZE CACHE_LINE_SIZE
+
+#define KMEM_MAX_CACHES 32
+
+static struct kmem_cache caches[KMEM_MAX_CACHES];
+static int ncaches = 0;
+static struct kmem_cache *cache_list = 0;
+static struct spinlock cache_list_lock = SPINLOCK_INIT("kmem_caches");
+
+/* kmalloc 尺寸类：16, 32, ..., KMALLOC_MAX_CACHE_SIZE */
+#define KMALLOC_MIN_SHIFT 4
+#define KMALLOC_MAX_SHIFT 10
+static struct kmem_cache *kmalloc_caches[KMALLOC_MAX_SHIFT + 1];
+static const char *kmalloc_names[KMALLOC_MAX_SHIFT + 1] = {
+    [4] = "kmalloc-16", [5] = "kmalloc-32", [6] = "kmalloc-64",
+    [7] = "kmalloc-128", [8] = "kmalloc-256", [9] = "kmalloc-512",
+    [10] = "kmalloc-1024",
+};
+
+static inline uint32_t roundup(uint32_t x, uint32_t a) {
+    return (x + a - 1) & ~(a - 1);
+}
+
+static void slab_unlink(struct slab **head, struct slab *s) {
+    if (s->prev) s->prev->next = s->next;
+    else *head = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->next = s->prev = 0;
+}
+
+static void slab_link(struct slab **head, struct slab *s) {
+    s->prev = 0;
+    s->next = *head;
+    if (*head) (*head)->prev = s;
+    *head = s;
+}
+
+/* 创建对象缓存 */
+struct kmem_cache *kmem_cache_create(const char *name, uint32_t size, uint32_t align) {
+    acquire(&cache_list_lock);
+    if (ncaches >= KMEM_MAX_CACHES || size == 0) {
+        release(&cache_list_lock);
+        printf("kmem_cache_create: cannot create cache %s\n", name);
+        return 0;
+    }
+    if (align < sizeof(void*)) align = sizeof(void*);
+
+    struct kmem_cache *c = &caches[ncaches++];
+    initlock(&c->lock, name);
+    c->name = name;
+    c->align = align;
+    c->size = roundup(size < sizeof(void*) ? sizeof(void*) : size, align);
+    c->offset = roundup(sizeof(struct slab), align);
+    c->objs_per_slab = (PGSIZE - c->offset) / c->size;
+    c->partial = 0;
+    c->full = 0;
+    c->nslabs = 0;
+    c->active = 0;
+    if (c->objs_per_slab == 0) {
+        ncaches--;
+        release(&cache_list_lock);
+        printf("kmem_cache_create: object too large for cache %s\n", name);
+        return 0;
+    }
+    c->next = cache_list;
+    cache_list = c;
+    release(&cache_list_lock);
+    return c;
+}
+
+/* 为缓存新建一个 slab：整页切分，空闲链表穿在对象内部。
+   调用时不持有 c->lock（分配页可能触发回收，回收又要用 kmalloc） */
+static struct slab *slab_grow(struct kmem_cache *c) {
+    char *page = (char*)alloc_page_nozero();
+    if (!page) return 0;
+    pmm_set_tag(page, PMM_TAG_SLAB);
+
+    struct slab *s = (struct slab*)page;
+    s->magic = SLAB_MAGIC;
+    s->inuse = 0;
+    s->cache = c;
+    s->next = s->prev = 0;
+    s->freelist = 0;
+    for (int i = c->objs_per_slab - 1; i >= 0; i--) {
+        void **obj = (void**)(page + c->offset + i * c->size);
+        *obj = s->freelist;
+        s->freelist = obj;
+    }
+    return s;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *c) {
+    if (!c) return 0;
+    acquire(&c->lock);
+    struct slab *s = c->partial;
+    if (!s) {
+        release(&c->lock);
+        s = slab_grow(c);
+        if (!s) return 0;
+        acquire(&c->lock);
+        c->nslabs++;
+        slab_link(&c->partial, s);
+    }
+
+    void **obj = (void**)s->freelist;
+    s->freelist = *obj;
+    s->inuse++;
+    c->active++;
+    if (s->inuse == c->objs_per_slab) {
+        slab_unlink(&c->partial, s);
+        slab_link(&c->full, s);
+    }
+    release(&c->lock);
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *c, void *obj) {
+    if (!obj) return;
+    struct slab *s = (struct slab*)PGROUNDDOWN((uint64_t)obj);
+    if (s->magic != SLAB_MAGIC || s->cache != c) {
+        printf("kmem_cache_free: %p does not belong to cache %s\n", obj, c ? c->name : "?");
+        return;
+    }
+
+    acquire(&c->lock);
+    if (s->inuse == c->objs_per_slab) {
+        slab_unlink(&c->full, s);
+        slab_link(&c->partial, s);
+    }
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+    s->inuse--;
+    c->active--;
+
+    /* slab 完全空闲时归还整页 */
+    if (s->inuse == 0) {
+        slab_unlink(&c->partial, s);
+        s->magic = 0;
+        c->nslabs--;
+        release(&c->lock);
+        free_page(s);
+        return;
+    }
+    release(&c->lock);
+}
+
+void kmem_init(void) {
+    for (int shift = KMALLOC_MIN_SHIFT; shift <= KMALLOC_MAX_SHIFT; shift++) {
+        uint32_t size = 1U << shift;
+        uint32_t align = size < CACHE_LINE_SIZE ? size : CACHE_LINE_SIZE;
+        kmalloc_caches[shift] = kmem_cache_create(kmalloc_names[shift], size, align);
+    }
+    printf("kmem_init: kmalloc caches %d..%d bytes ready\n",
+           1 << KMALLOC_MIN_SHIFT, KMALLOC_MAX_CACHE_SIZE);
+}
+
+void *kmalloc(uint64_t size) {
+    if (size == 0) return 0;
+
+    if (size <= KMALLOC_MAX_CACHE_SIZE) {
+        int shift = KMALLOC_MIN_SHIFT;
+        while ((1UL << shift) < size) shift++;
+        return kmem_cache_alloc(kmalloc_caches[shift]);
+    }
+
+    /* 大块：按页分配，块头记录阶数 */
+    int order = 0;
+    while (((uint64_t)PGSIZE << order) < size + LARGE_HDR_SIZE) order++;
+    struct large_hdr *h = (struct large_hdr*)alloc_pages(order);
+    if (!h) return 0;
+    h->magic = LARGE_MAGIC;
+    h->order = order;
+    return (char*)h + LARGE_HDR_SIZE;
+}
+
+void kfree(void *ptr) {
+    if (!ptr) return;
+    void *page = (void*)PGROUNDDOWN((uint64_t)ptr);
+    struct slab *s = (struct slab*)page;
+    if (s->magic == SLAB_MAGIC) {
+        kmem_cache_free(s->cache, ptr);
+        return;
+    }
+    struct large_hdr *h = (struct large_hdr*)page;
+    if (h->magic == LARGE_MAGIC && (char*)ptr == (char*)h + LARGE_HDR_SIZE) {
+        h->magic = 0;
+        free_pages(h, h->order);
+        return;
+    }
+    printf("kfree: invalid pointer %p\n", ptr);
+}
+
+void kmem_dump(void) {
+    for (struct kmem_cache *c = cache_list; c; c = c->next) {
+        printf("kmem: %s objsize=%d active=%lu slabs=%lu\n", c->name, (int)c->size,
+               (unsigned long)c->active, (unsigned long)c->nslabs);
+    }
+}
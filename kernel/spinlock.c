@@ -0,0 +1,67 @@
+#include "riscv.h"
+#include "printf.h"
+#include "spinlock.h"
+#include "proc.h"
+
+/* 锁使用错误：不能再走 printf（它本身也要拿锁），直接输出后停机 */
+static void lock_panic(const char *msg, struct spinlock *lk) {
+    console_puts(msg);
+    console_puts(lk ? lk->name : "?");
+    console_puts("\n");
+    for (;;) __asm__ volatile("wfi");
+}
+
+void initlock(struct spinlock *lk, const char *name) {
+    lk->locked = 0;
+    lk->name = name;
+    lk->cpu = 0;
+}
+
+int holding(struct spinlock *lk) {
+    return lk->locked && lk->cpu == mycpu();
+}
+
+void acquire(struct spinlock *lk) {
+    push_off();
+    if (holding(lk)) lock_panic("acquire: already holding ", lk);
+    /* amoswap.w.aq：拿到锁之前一直自旋 */
+    while (__sync_lock_test_and_set(&lk->locked, 1) != 0)
+        ;
+    __sync_synchronize();
+    lk->cpu = mycpu();
+}
+
+int try_acquire(struct spinlock *lk) {
+    push_off();
+    if (holding(lk) || __sync_lock_test_and_set(&lk->locked, 1) != 0) {
+        pop_off();
+        return 0;
+    }
+    __sync_synchronize();
+    lk->cpu = mycpu();
+    return 1;
+}
+
+void release(struct spinlock *lk) {
+    if (!holding(lk)) lock_panic("release: not holding ", lk);
+    lk->cpu = 0;
+    __sync_synchronize();
+    __sync_lock_release(&lk->locked);
+    pop_off();
+}
+
+void push_off(void) {
+    int old = intr_get();
+    intr_off();
+    struct cpu *c = mycpu();
+    if (c->noff == 0) c->intena = old;
+    c->noff++;
+}
+
+void pop_off(void) {
+    struct cpu *c = mycpu();
+    if (intr_get()) lock_panic("pop_off: interruptible", 0);
+    if (c->noff < 1) lock_panic("pop_off: unbalanced", 0);
+    c->noff--;
+    if (c->noff == 0 && c->intena) intr_on();
+}
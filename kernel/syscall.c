@@ -1,119 +1,49 @@
 #include "riscv.h"
 #include "printf.h"
 #include "proc.h"
+#include "spinlock.h"
 #include "syscall.h"
 #include "memlayout.h"
 #include "vmm.h"  // 新增：用于获取进程页表
 #include "fs.h"   // 文件系统接口
+#include "pmm.h"  // 内存统计
+#include "ring.h" // 提交/完成环
+#include "errno.h"
 
-extern struct proc proc[];
 
-/* 从用户空间拷贝数据到内核空间
-   注意：当前实现是简化版本，因为所有进程共享内核页表
-   完整实现需要遍历用户页表验证地址有效性
-*/
-static int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len) {
-    // 基本边界检查：简单限制在 39 位虚拟地址范围内
-    if (srcva >= (1L << 39) || srcva + len > (1L << 39)) {
-        return -1;  // 地址超出39位虚拟地址空间
-    }
+/* 内核地址的缓冲区只接受调用者自己的内核栈和只读数据（见 kernel_buf_ok），通过检查的直接交给
+   文件系统和控制台，其余内核地址返回 -EFAULT；用户地址经 copyin/copyout 分块中转 */
+#define BOUNCE_SIZE 512
 
-    // 目前还没有真正的“用户页表”支持，这里做一个保守的安全检查：
-    // - 对于小于 KERNBASE 的地址，一律认为是“用户空间”且暂时不可信，直接报错
-    //   这样可以避免像 0x01000000 这样的坏指针导致访存异常。
-    if (srcva < KERNBASE) {
-        return -1;
-    }
+/* write系统调用：fd 1/2 输出到控制台，其余写入文件 */
+long do_write(long fd, const char *buf, long cnt) {
+    if (cnt <= 0) return 0;
+    if (buf == 0 || fd < 0) return -1;
+    int console = fd == 1 || fd == 2;
 
-    // 对于内核空间地址（>= KERNBASE），直接拷贝。
-    // 这覆盖了当前 demo 中的“用户缓冲区”（实际仍在内核栈中）的情况。
-    char *src = (char*)srcva;
-    for (uint64 i = 0; i < len; i++) {
-        dst[i] = src[i];
+    if ((uint64)buf >= KERNBASE) {
+        if (!kernel_buf_ok(myproc(), (uint64)buf, cnt, 0)) return -EFAULT;
+        if (!console) return fs_write_fd(fd, buf, cnt);
+        for (long i = 0; i < cnt; i++) console_putc(buf[i]);
+        return cnt;
     }
-    return 0;
-}
 
-/* 从内核空间拷贝数据到用户空间（当前未使用，如需可启用） */
-// static int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len) {
-//     if (dstva >= (1L << 39) || dstva + len > (1L << 39)) {
-//         return -1;
-//     }
-//     
-//     // 简化实现：直接拷贝
-//     char *dst = (char*)dstva;
-//     for (uint64 i = 0; i < len; i++) {
-//         dst[i] = src[i];
-//     }
-//     return 0;
-// }
-
-/* 改进的write系统调用，支持用户空间地址 */
-static long do_write(long fd, const char *buf, long cnt) {
-    if (cnt <= 0) return 0;
-    if (buf == 0) return -1;
-    
-    if (fd == 1 || fd == 2) {
-        // 标准输出/错误，使用原来的控制台输出
-        // 判断是用户地址还是内核地址
-        if ((uint64)buf < KERNBASE) {
-            // 用户空间地址，需要拷贝到内核缓冲区
-            char kbuf[256];  // 内核缓冲区
-            long total_written = 0;
-            long remaining = cnt;
-            
-            // 分段拷贝和输出（处理大于缓冲区的情况）
-            while (remaining > 0) {
-                long to_copy = remaining < 256 ? remaining : 256;
-                
-                // 从用户空间拷贝到内核缓冲区
-                if (copyin(0, kbuf, (uint64)buf + total_written, to_copy) < 0) {
-                    return total_written > 0 ? total_written : -1;
-                }
-                
-                // 输出到控制台
-                for (long i = 0; i < to_copy; i++) {
-                    console_putc(kbuf[i]);
-                }
-                
-                total_written += to_copy;
-                remaining -= to_copy;
-            }
-            return total_written;
+    char kbuf[BOUNCE_SIZE];
+    long total = 0;
+    while (total < cnt) {
+        long n = cnt - total < BOUNCE_SIZE ? cnt - total : BOUNCE_SIZE;
+        int r = copyin(myproc(), kbuf, (uint64)buf + total, n);
+        if (r < 0) return total > 0 ? total : r;
+        if (console) {
+            for (long i = 0; i < n; i++) console_putc(kbuf[i]);
         } else {
-            // 内核地址，直接使用
-            for (long i = 0; i < cnt; i++) {
-                console_putc(buf[i]);
-            }
-            return cnt;
+            long w = fs_write_fd(fd, kbuf, n);
+            if (w <= 0) return total > 0 ? total : w;
+            if (w < n) return total + w;
         }
-    } else if (fd >= 0) {
-        // 文件描述符，使用文件系统
-        char kbuf[256];
-        long total_written = 0;
-        long remaining = cnt;
-        
-        while (remaining > 0) {
-            long to_copy = remaining < 256 ? remaining : 256;
-            
-            // 从用户空间拷贝到内核缓冲区
-            if (copyin(0, kbuf, (uint64)buf + total_written, to_copy) < 0) {
-                return total_written > 0 ? total_written : -1;
-            }
-            
-            // 写入文件
-            long n = fs_write_fd(fd, kbuf, to_copy);
-            if (n <= 0) break;
-            
-            total_written += n;
-            remaining -= n;
-            if (n < to_copy) break;
-        }
-        
-        return total_written;
-    } else {
-        return -1;
+        total += n;
     }
+    return total;
 }
 
 /* 改进的kill系统调用 */
@@ -125,27 +55,54 @@ static long do_kill(int pid) {
         return -1;
     }
     
-    // 查找目标进程
-    for (int i = 0; i < NPROC; i++) {
-        p = &proc[i];
-        if (p->state != UNUSED && p->pid == pid) {
-            p->killed = 1;
-            
-            // 如果进程在睡眠，唤醒它以便检查killed标志
-            if (p->state == SLEEPING) {
-                p->state = RUNNABLE;
-                wakeup(p->chan);
-            }
-            
-            return 0;
-        }
+    // 按 pid 查找目标进程（持有 proc_lock，目标不会在此期间被其他 hart 回收）
+    acquire(&proc_lock);
+    p = proc_find(pid);
+    if (p == 0 || p->state == UNUSED) {
+        release(&proc_lock);
+        return -1;  // 进程不存在
+    }
+    p->killed = 1;
+
+    // 如果进程在睡眠，从等待队列摘除并置为可运行以便检查killed标志
+    if (p->state == SLEEPING) {
+        proc_setrunnable(p);
+    }
+    release(&proc_lock);
+    return 0;
+}
+
+/* fork 的子进程内核栈：复制父进程栈上正在使用的部分 [sp, 栈顶)（sys_fork → handle_syscall →
+   ecall_entry 的各帧，以及发起 ecall 的代码自己的帧）。其中指向这一范围的字（帧指针、
+   溢出到栈上的指针寄存器、指向栈上变量的指针）按两栈的距离重定位，上下文中的 sp、s0-s11 同样处理。
+   没有类型信息：恰好等于这一范围内地址的整数也会被改写（fork_demo 里有对应的检查）。
+   重定位后沿帧指针链（-fno-omit-frame-pointer，fp-16 处为上一帧的 fp，最外层 proc_trampoline 的为 0）
+   检查每一帧都落在子进程栈内且逐帧上升，不一致时返回 -1，让 fork 失败而不是在错误的栈上运行子进程 */
+static __attribute__((noinline)) int fork_kstack(struct proc *p, struct proc *np) {
+    uint64 lo = np->context.sp, hi = (uint64)p->kstack + KSTACK_SIZE;
+    uint64 delta = (uint64)np->kstack - (uint64)p->kstack;
+    uint64 *src = (uint64*)lo;
+    uint64 *dst = (uint64*)(lo + delta);
+    for (; (uint64)src < hi; src++, dst++) {
+        uint64 w = *src;
+        *dst = (w >= lo && w <= hi) ? w + delta : w;
+    }
+    uint64 *c = (uint64*)&np->context;
+    for (int k = 1; k < sizeof(struct context)/8; k++) {
+        if (c[k] >= lo && c[k] <= hi) c[k] += delta;
+    }
+    uint64 prev = lo + delta;
+    for (uint64 fp = np->context.s0; fp != 0; fp = ((uint64*)fp)[-2]) {
+        if (fp <= prev || fp > hi + delta) return -1;
+        prev = fp;
     }
-    return -1;  // 进程不存在
+    return 0;
 }
 
 /* fork系统调用：创建当前进程的副本
    返回值：父进程返回子进程pid，子进程返回0
-   注意：这是内核线程风格的简化fork，不复制页表
+   子进程得到父进程内核栈的副本，第一次被调度时从 savecontext 第二次返回，
+   沿同一条调用链回到 ecall 之后；用户区以写时复制方式共享
 */
 static long do_fork(void) {
     struct proc *p = myproc();
@@ -161,26 +118,37 @@ static long do_fork(void) {
         return -1;
     }
     
-    // 复制父进程的上下文
-    np->context = p->context;
-    
-    // 确保子进程有独立的内核栈
-    if (np->kstack) {
-        // 设置子进程的栈指针（新栈）
-        uint64 kstack_top = (uint64)np->kstack + PGSIZE;
-        np->context.sp = kstack_top;
+    // 用户区写时复制：共享父进程的物理页，首次写入时再复制
+    if (proc_vm_fork(p, np) < 0) {
+        printf("fork: out of memory copying page table\n");
+        freeproc(np);
+        return -1;
+    }
+
+    // 子进程继承调度优先级
+    np->nice = p->nice;
+    np->weight = p->weight;
+
+    /* 子进程恢复运行时的中断使能状态与父进程此刻相同（系统调用中通常为关） */
+    int intena = intr_get();
+    if (savecontext(&np->context)) {
+        /* 子进程：与 proc_trampoline 相同，调度器切换过来时持有 proc_lock */
+        w_mscratch((uint64)&myproc()->tf);
+        mycpu()->intena = intena;
+        release(&proc_lock);
+        return 0;
+    }
+    if (fork_kstack(p, np) < 0) {
+        printf("fork: frame chain outside the child's kernel stack\n");
+        freeproc(np);
+        return -1;
     }
     
-    // 设置父子关系
-    np->parent = p->pid;
-    
-    // 关键：设置fork返回值
-    // 父进程直接返回子进程pid（通过函数返回值）
-    // 子进程通过fork_ret返回0（在handle_syscall中处理）
-    np->fork_ret = 0;        // 子进程返回0
-    
-    // 子进程状态设为RUNNABLE
-    np->state = RUNNABLE;
+    // 挂到父进程的子进程链表上，状态设为RUNNABLE（之后其他 hart 的调度器即可选中它）
+    acquire(&proc_lock);
+    proc_add_child(p, np);
+    proc_setrunnable(np);
+    release(&proc_lock);
     
     // 父进程返回子进程pid
     return np->pid;
@@ -189,126 +157,273 @@ static long do_fork(void) {
 // 在do_fork函数后添加文件系统系统调用处理函数
 
 /* open系统调用 */
-static long do_open(const char *pathname, int flags) {
+long do_open(const char *pathname, int flags) {
     if (!pathname) return -1;
-    
-    // 从用户空间拷贝路径名（简化：假设是内核地址）
     char kpath[FS_NAME_LEN];
-    int pathlen = 0;
-    while (pathlen < FS_NAME_LEN - 1 && pathname[pathlen]) {
-        kpath[pathlen] = pathname[pathlen];
-        pathlen++;
-    }
-    kpath[pathlen] = 0;
-    
+    int r = copyinstr(myproc(), kpath, (uint64)pathname, FS_NAME_LEN);
+    if (r < 0) return r;
     return fs_open(kpath, flags);
 }
 
+/* sbrk系统调用：堆增长/收缩 n 字节，返回原来的末尾地址。
+   增长时只扩展堆区，物理页在首次访问时由缺页处理分配 */
+static long do_sbrk(long n) {
+    struct proc *p = myproc();
+    if (!p) return -1;
+    uint64 oldsz = p->sz;
+    if (n < 0 && (uint64)(-n) > oldsz) return -1;
+    if (proc_vm_setbrk(p, oldsz + n) < 0) return -1;
+    return (long)(USERBASE + oldsz);
+}
+
+/* mmap系统调用：把文件私有映射到进程地址空间，页面在首次访问时装入 */
+static long do_mmap(int fd, long len, int prot) {
+    struct proc *p = myproc();
+    if (!p || len <= 0) return -1;
+    int perm = PTE_R;
+    if (prot & PTE_W) perm |= PTE_W;
+    uint64 va = proc_vm_mmap_file(p, fd, len, perm);
+    return va ? (long)va : -1;
+}
+
+/* meminfo系统调用：把物理内存统计写入 buf，buf 为 0 时打印到控制台 */
+static long do_meminfo(struct pmm_stats *buf) {
+    if (buf == 0) {
+        meminfo_dump();
+        return 0;
+    }
+    struct pmm_stats st;
+    pmm_get_stats(&st);
+    return copyout(myproc(), (uint64)buf, &st, sizeof(st));
+}
+
+/* setpriority系统调用：设置 pid（0 为自己）的 nice 值，范围 NICE_MIN..NICE_MAX */
+static long do_setpriority(int pid, int nice) {
+    return proc_setnice(pid, nice);
+}
+
+/* nanosleep系统调用：mtime 每个计数 1000000000/MTIME_FREQ 纳秒 */
+static long do_nanosleep(long ns) {
+    if (ns < 0) return -1;
+    return sleep_until(get_time() + (uint64)ns / (1000000000ULL / MTIME_FREQ));
+}
+
 /* close系统调用 */
 static long do_close(int fd) {
     return fs_close(fd);
 }
 
-/* read系统调用（文件系统版本） */
-static long do_read(int fd, void *buf, long count) {
-    if (fd < 0 || !buf || count < 0) return -1;
-    
-    // 判断是标准输入还是文件描述符
-    if (fd == 0) {
-        // 标准输入（当前不支持）
-        return -1;
-    } else if (fd == 1 || fd == 2) {
-        // 标准输出/错误（不应该read）
-        return -1;
-    } else {
-        // 文件描述符
-        char kbuf[256];
-        long total_read = 0;
-        long remaining = count;
-        
-        while (remaining > 0) {
-            long to_read = remaining < 256 ? remaining : 256;
-            long n = fs_read_fd(fd, kbuf, to_read);
-            if (n <= 0) break;
-            
-            // 拷贝到用户空间（简化：直接拷贝）
-            char *ubuf = (char*)buf;
-            for (long i = 0; i < n; i++) {
-                ubuf[total_read + i] = kbuf[i];
-            }
-            
-            total_read += n;
-            remaining -= n;
-            if (n < to_read) break;  // 到达文件末尾
+/* read系统调用（文件系统版本）：fd 0/1/2 不支持读 */
+long do_read(int fd, void *buf, long count) {
+    if (fd <= 2 || !buf || count < 0) return -1;
+    if ((uint64)buf >= KERNBASE) {
+        if (!kernel_buf_ok(myproc(), (uint64)buf, count, 1)) return -EFAULT;
+        return fs_read_fd(fd, buf, count);
+    }
+
+    char kbuf[BOUNCE_SIZE];
+    long total = 0;
+    while (total < count) {
+        long want = count - total < BOUNCE_SIZE ? count - total : BOUNCE_SIZE;
+        long n = fs_read_fd(fd, kbuf, want);
+        if (n <= 0) return total > 0 ? total : n;
+        int r = copyout(myproc(), (uint64)buf + total, kbuf, n);
+        if (r < 0) return total > 0 ? total : r;
+        total += n;
+        if (n < want) break;  // 到达文件末尾
+    }
+    return total;
+}
+
+/* ====== 分发表 ======
+   每个系统调用的包装函数从 args[0..5]（即 a0..a5）取参数 */
+
+static long sys_getpid(uint64 *args) {
+    return myproc() ? myproc()->pid : -1;
+}
+
+static long sys_exit(uint64 *args) {
+    /* a0 = exit code, 不会返回 */
+    exit_process((int)args[0]);
+    return 0;  // 不会执行到这里
+}
+
+/* 退出码先收到内核变量里，waitpid 放锁并回收子进程后再拷给调用者；status 为 0 表示不要退出码 */
+static long wait_status_out(long pid, uint64 status, int st) {
+    if (pid > 0 && status && copyout(myproc(), status, &st, sizeof(st)) < 0) return -EFAULT;
+    return pid;
+}
+
+static long sys_wait(uint64 *args) {
+    int st = 0;
+    return wait_status_out(wait_process(&st), args[0], st);
+}
+
+static long sys_waitpid(uint64 *args) {
+    int st = 0;
+    return wait_status_out(waitpid((int)args[0], &st, (int)args[2]), args[1], st);
+}
+
+static long sys_kill(uint64 *args) {
+    return do_kill((int)args[0]);
+}
+
+static long sys_write(uint64 *args) {
+    return do_write((int)args[0], (const char*)args[1], (long)args[2]);
+}
+
+static long sys_fork(uint64 *args) {
+    return do_fork();
+}
+
+static long sys_open(uint64 *args) {
+    return do_open((const char*)args[0], (int)args[1]);
+}
+
+static long sys_close(uint64 *args) {
+    return do_close((int)args[0]);
+}
+
+static long sys_read(uint64 *args) {
+    return do_read((int)args[0], (void*)args[1], (long)args[2]);
+}
+
+static long sys_sbrk(uint64 *args) {
+    return do_sbrk((long)args[0]);
+}
+
+static long sys_mmap(uint64 *args) {
+    return do_mmap((int)args[0], (long)args[1], (int)args[2]);
+}
+
+static long sys_meminfo(uint64 *args) {
+    return do_meminfo((struct pmm_stats*)args[0]);
+}
+
+static long sys_setpriority(uint64 *args) {
+    return do_setpriority((int)args[0], (int)args[1]);
+}
+
+static long sys_nanosleep(uint64 *args) {
+    return do_nanosleep((long)args[0]);
+}
+
+static long sys_trace(uint64 *args) {
+    syscall_trace_mask = args[0];
+    return 0;
+}
+
+static long sys_ring_setup(uint64 *args) {
+    struct ring *r = ring_setup(myproc());
+    return r ? (long)r : -1;
+}
+
+static long sys_ring_enter(uint64 *args) {
+    return ring_enter(myproc(), (uint32_t)args[0]);
+}
+
+static const struct {
+    const char *name;
+    long (*fn)(uint64 *args);
+} syscalls[SYS_MAX + 1] = {
+    [SYS_getpid]      = { "getpid",      sys_getpid },
+    [SYS_exit]        = { "exit",        sys_exit },
+    [SYS_wait]        = { "wait",        sys_wait },
+    [SYS_kill]        = { "kill",        sys_kill },
+    [SYS_write]       = { "write",       sys_write },
+    [SYS_read]        = { "read",        sys_read },
+    [SYS_fork]        = { "fork",        sys_fork },
+    [SYS_open]        = { "open",        sys_open },
+    [SYS_close]       = { "close",       sys_close },
+    [SYS_sbrk]        = { "sbrk",        sys_sbrk },
+    [SYS_mmap]        = { "mmap",        sys_mmap },
+    [SYS_meminfo]     = { "meminfo",     sys_meminfo },
+    [SYS_setpriority] = { "setpriority", sys_setpriority },
+    [SYS_nanosleep]   = { "nanosleep",   sys_nanosleep },
+    [SYS_waitpid]     = { "waitpid",     sys_waitpid },
+    [SYS_trace]       = { "trace",       sys_trace },
+    [SYS_ring_setup]  = { "ring_setup",  sys_ring_setup },
+    [SYS_ring_enter]  = { "ring_enter",  sys_ring_enter },
+};
+
+/* 每个系统调用的次数和耗时（mcycle）。直方图第 i 格统计耗时在 [2^i, 2^(i+1)) 个周期的调用，
+   最后一格包含更长的调用。各 hart 并发更新，用原子加。
+   mcycle 是每个 hart 各自的计数器：睡眠后换到其他 hart 继续的调用无法计时，只计入 migrated */
+static struct {
+    uint64 calls;
+    uint64 migrated;
+    uint64 cycles;
+    uint64 hist[SYSCALL_HIST_BUCKETS];
+} sc_stats[SYS_MAX + 1];
+
+volatile uint64 syscall_trace_mask = 0;
+
+static int hist_bucket(uint64 cycles) {
+    int b = 0;
+    while (cycles > 1 && b < SYSCALL_HIST_BUCKETS - 1) {
+        cycles >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void syscall_stats_dump(void) {
+    printf("syscall: name calls avg-cycles histogram(log2 cycles:count)\n");
+    for (int n = 1; n <= SYS_MAX; n++) {
+        if (syscalls[n].fn == 0 || sc_stats[n].calls == 0) continue;
+        uint64 timed = sc_stats[n].calls - sc_stats[n].migrated;
+        printf("syscall: %s %lu %lu", syscalls[n].name, (unsigned long)sc_stats[n].calls,
+               (unsigned long)(timed ? sc_stats[n].cycles / timed : 0));
+        if (sc_stats[n].migrated) printf(" migrated=%lu", (unsigned long)sc_stats[n].migrated);
+        for (int b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+            if (sc_stats[n].hist[b]) printf(" %d:%lu", b, (unsigned long)sc_stats[n].hist[b]);
         }
-        
-        return total_read;
+        printf("\n");
     }
 }
 
-/* 从保存区读取参数并分发
-   saved 指向 kernelvec.S 保存寄存器的区域（按字64位）
+/* 按调用号分发。args 指向 kernelvec.S 中 ecall 入口在栈上保存的 a0..a7（按字64位），
+   参数取 args[0..5]，调用号为 args[7]；返回值由入口放回 a0
 */
-void handle_syscall(uint64 *saved) {
-    /* kernelvec.S 保存寄存器顺序与偏移（字节）：
-       a0 @ offset 64, a1 @ 72, a2 @ 80, ..., a7 @ 120
-       64/8 = index 8, a7 index = 15
-    */
-    uint64 a0 = saved[8];
-    uint64 a1 = saved[9];
-    uint64 a2 = saved[10];
-    uint64 syscallnum = saved[15];
+long handle_syscall(uint64 *args) {
+    uint64 num = args[7];
 
     // 验证系统调用号范围
-    if (syscallnum > 10) {  // 假设最大系统调用号为10
-        printf("Invalid syscall number: %lu\n", (unsigned long)syscallnum);
-        saved[8] = -1;
-        return;
+    if (num > SYS_MAX || syscalls[num].fn == 0) {
+        printf("Invalid syscall number: %lu\n", (unsigned long)num);
+        return -1;
+    }
+
+    /* 跟踪点：按 syscall_trace_mask 运行时开关，默认关闭 */
+    int trace = (syscall_trace_mask >> num) & 1;
+    if (trace) {
+        printf("[trace] pid=%d %s(%lx, %lx, %lx, %lx, %lx, %lx)\n", myproc() ? myproc()->pid : -1,
+               syscalls[num].name, (unsigned long)args[0], (unsigned long)args[1], (unsigned long)args[2],
+               (unsigned long)args[3], (unsigned long)args[4], (unsigned long)args[5]);
     }
 
-    long ret = -1;
-    switch (syscallnum) {
-        case SYS_getpid:
-            ret = myproc() ? myproc()->pid : -1;
-            break;
-        case SYS_exit:
-            /* a0 = exit code, 不会返回 */
-            exit_process((int)a0);
-            ret = 0;  // 不会执行到这里
-            break;
-        case SYS_wait:
-            ret = wait_process((int*)a0);
-            break;
-        case SYS_kill:
-            ret = do_kill((int)a0);
-            break;
-        case SYS_write:
-            ret = do_write((int)a0, (const char*)a1, (long)a2);
-            break;
-        case SYS_fork:
-            ret = do_fork();
-            // fork的特殊处理：检查fork_ret字段
-            // 如果设置了fork_ret，使用它作为返回值
-            if (myproc() && myproc()->fork_ret >= 0) {
-                ret = myproc()->fork_ret;
-                myproc()->fork_ret = -1;  // 清除标志，只使用一次
-            }
-            break;
-        case SYS_open:
-            ret = do_open((const char*)a0, (int)a1);
-            break;
-        case SYS_close:
-            ret = do_close((int)a0);
-            break;
-        case SYS_read:
-            ret = do_read((int)a0, (void*)a1, (long)a2);
-            break;
-        default:
-            printf("Unknown syscall num=%lu\n", (unsigned long)syscallnum);
-            ret = -1;
-            break;
+    int hart = cpuid();
+    uint64 t0 = r_mcycle();
+    long ret = syscalls[num].fn(args);
+    uint64 dt = r_mcycle() - t0;
+
+    __atomic_fetch_add(&sc_stats[num].calls, 1, __ATOMIC_RELAXED);
+    if (cpuid() != hart) {
+        __atomic_fetch_add(&sc_stats[num].migrated, 1, __ATOMIC_RELAXED);
+        dt = 0;
+    } else {
+        __atomic_fetch_add(&sc_stats[num].cycles, dt, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&sc_stats[num].hist[hist_bucket(dt)], 1, __ATOMIC_RELAXED);
+    }
+
+    if (trace) {
+        printf("[trace] pid=%d %s -> %ld (%lu cycles)\n", myproc() ? myproc()->pid : -1,
+               syscalls[num].name, ret, (unsigned long)dt);
     }
 
-    /* 将返回值写回 saved a0 */
-    saved[8] = (uint64)ret;
-}
\ No newline at end of file
+    /* 被杀死的进程在系统调用返回前自己退出：睡眠已返回，定时器等栈上对象都已撤销 */
+    struct proc *p = myproc();
+    if (p && p->killed) exit_process(-1);
+
+    return ret;
+}
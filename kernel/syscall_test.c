@@ -1,7 +1,14 @@
 #include "printf.h"
 #include "proc.h"
 #include "syscall.h"
+#include "pmm.h"
 #include "trap.h"   /* for ticks */
+#include "fs.h"
+#include "ring.h"
+#include "vdso.h"
+#include "memlayout.h"
+#include "vmm.h"
+#include "zram.h"
 
 extern volatile uint64 ticks;
 
@@ -18,7 +25,9 @@ static long do_syscall(long num, long a0, long a1, long a2) {
         "mv %0, a0\n"
         : "=r"(ret)
         : "r"(a0), "r"(a1), "r"(a2), "r"(num)
-        : "a0","a1","a2","a7","memory"
+        /* ecall 按函数调用约定处理：调用者保存寄存器都可能被改写 */
+        : "ra","t0","t1","t2","t3","t4","t5","t6",
+          "a0","a1","a2","a3","a4","a5","a6","a7","memory"
     );
     return ret;
 }
@@ -30,21 +39,214 @@ static int strlen_local(const char *s) {
     return i;
 }
 
-/* 演示进程 */
-static void demo_task(void) {
-    // 避免由于当前 fork 实现为“内核线程克隆”导致子进程从头再跑一遍，
-    // 进而形成 syscall demo 无限链式执行：只允许完整跑一次。
-    static int ran_once = 0;
-    if (ran_once) {
-        do_syscall(SYS_exit, 0, 0, 0);
+/* 睡一个节拍 */
+static void demo_nap(void) {
+    do_syscall(SYS_nanosleep, 1000000000L / MTIME_FREQ * TICK_INTERVAL, 0, 0);
+}
+
+/* wakeup_one：两个进程睡在同一个 chan 上，只应醒来一个 */
+static int herd_chan;
+static volatile int herd_ready, herd_woken;
+
+static void herd_worker(void) {
+    __atomic_fetch_add(&herd_ready, 1, __ATOMIC_SEQ_CST);
+    sleep(&herd_chan);
+    __atomic_fetch_add(&herd_woken, 1, __ATOMIC_SEQ_CST);
+    exit_process(0);
+}
+
+static void herd_demo(void) {
+    int n = 0;
+    herd_ready = herd_woken = 0;
+    for (int i = 0; i < 2; i++) {
+        if (create_process(herd_worker) >= 0) n++;
     }
-    ran_once = 1;
+    /* sleep 不带条件：多等一个节拍确保两个都已入睡，最后的 wakeup 重试到全部醒来 */
+    while (herd_ready < n) demo_nap();
+    demo_nap();
+    wakeup_one(&herd_chan);
+    demo_nap();
+    printf("demo: wakeup_one woke %d of %d sleepers (should be 1)\n", herd_woken, n);
+    while (herd_woken < n) {
+        wakeup(&herd_chan);
+        demo_nap();
+    }
+}
 
-    /* 等待短时间以保证前面实验输出完成（基于相对 ticks） */
-    uint64 start = ticks;
-    while (ticks < start + 1) {
-        yield(); /* 让出 CPU，等待调度器再次执行 */
+/* waitpid：用 SYS_fork 建立子进程，子进程执行 entry（各 entry 都以 exit_process 结束） */
+static int spawn_child(void (*entry)(void)) {
+    long pid = do_syscall(SYS_fork, 0, 0, 0);
+    if (pid == 0) {
+        entry();
+        exit_process(0);
     }
+    return (int)pid;
+}
+
+static volatile int orphan_pid;
+
+static void slow_child(void) {
+    for (int i = 0; i < 3; i++) demo_nap();
+    exit_process(42);
+}
+
+/* 中间进程：建立孙进程后立即退出，孙进程成为孤儿，退出时由调度器回收 */
+static void orphan_child(void) {
+    demo_nap();
+    demo_nap();
+    exit_process(7);
+}
+
+static void middle_child(void) {
+    orphan_pid = spawn_child(orphan_child);
+    exit_process(1);
+}
+
+static int proc_alive(int pid) {
+    acquire(&proc_lock);
+    int alive = proc_find(pid) != 0;
+    release(&proc_lock);
+    return alive;
+}
+
+/* 换出/换入：堆上写入两页，vm_reclaim 把它们压缩进 zram，再读回比较 */
+static void swap_demo(void) {
+    struct proc *p = myproc();
+    long heap = do_syscall(SYS_sbrk, 2 * PGSIZE, 0, 0);
+    if (heap == -1) return;
+    uint64 pat[PGSIZE / 64];
+    for (int i = 0; i < PGSIZE / 64; i++) pat[i] = i * 0x0101010101ULL;
+    for (int i = 0; i < 2 * 8; i++) copyout(p, heap + i * sizeof(pat), pat, sizeof(pat));
+    int before = p->nfault_swap;
+    /* 第一圈清除访问位，第二圈换出 */
+    int n = vm_reclaim(2) + vm_reclaim(2);
+    int ok = 1;
+    for (int i = 0; i < 2 * 8; i++) {
+        uint64 back[PGSIZE / 64];
+        if (copyin(p, back, heap + i * sizeof(back), sizeof(back)) < 0) ok = 0;
+        for (int j = 0; ok && j < PGSIZE / 64; j++) {
+            if (back[j] != pat[j]) ok = 0;
+        }
+    }
+    printf("demo: vm_reclaim swapped out %d pages, swap-in faults=%d, contents %s\n",
+           n, p->nfault_swap - before, ok ? "intact" : "CORRUPTED");
+    zram_dump();
+}
+
+/* 文件映射持有文件引用：关闭 fd、删除文件、槽位被新文件占用后，缺页装入的仍是原内容 */
+static void mmap_demo(void) {
+    const char *data = "mapped file data\n";
+    int len = strlen_local(data);
+    long fd = do_syscall(SYS_open, (long)"mapdemo", O_CREATE | O_RDWR, 0);
+    if (fd < 0) return;
+    do_syscall(SYS_write, fd, (long)data, len);
+    long va = do_syscall(SYS_mmap, fd, len, 0);
+    do_syscall(SYS_close, fd, 0, 0);
+    fs_unlink("mapdemo");
+    long ofd = do_syscall(SYS_open, (long)"mapother", O_CREATE | O_RDWR, 0);
+    if (ofd >= 0) {
+        do_syscall(SYS_write, ofd, (long)"XXXXXXXXXXXXXXXX\n", 17);
+        do_syscall(SYS_close, ofd, 0, 0);
+    }
+    if (va != -1) {
+        printf("demo: mmap of unlinked file reads: ");
+        do_syscall(SYS_write, 1, va, len);
+        printf("demo: exec fault on non-executable mapping returned %d (should be -1)\n",
+               vm_fault(myproc(), va, FAULT_EXEC));
+    }
+    fs_unlink("mapother");
+}
+
+static void waitpid_demo(void) {
+    int status = -1;
+    int pid = spawn_child(slow_child);
+    if (pid < 0) return;
+    long r = do_syscall(SYS_waitpid, pid, (long)&status, WNOHANG);
+    printf("demo: waitpid(%d, WNOHANG) while running returned %ld (should be 0)\n", pid, r);
+    r = do_syscall(SYS_waitpid, pid, (long)&status, 0);
+    printf("demo: blocking waitpid(%d) returned %ld status=%d (should be %d, 42)\n", pid, r, status, pid);
+
+    /* 退出码只经 copyout 写回：指向内核数据时返回 -EFAULT，ticks 不会被改写 */
+    pid = spawn_child(orphan_child);
+    if (pid < 0) return;
+    r = do_syscall(SYS_waitpid, pid, (long)&ticks, 0);
+    printf("demo: waitpid(%d) into kernel data returned %ld (should be -EFAULT)\n", pid, r);
+
+    orphan_pid = -1;
+    pid = spawn_child(middle_child);
+    if (pid < 0) return;
+    r = do_syscall(SYS_waitpid, -1, (long)&status, 0);
+    printf("demo: waitpid(-1) returned %ld status=%d (should be %d, 1)\n", r, status, pid);
+    if (orphan_pid > 0) {
+        int naps = 0;
+        while (proc_alive(orphan_pid) && naps < 20) {
+            demo_nap();
+            naps++;
+        }
+        printf("demo: orphan pid=%d reaped by scheduler: %s\n", orphan_pid, proc_alive(orphan_pid) ? "no" : "yes");
+    }
+    r = do_syscall(SYS_waitpid, -1, (long)&status, 0);
+    printf("demo: waitpid(-1) with no children returned %ld (should be -1)\n", r);
+}
+
+/* fork：子进程在 ecall 之后返回 0，继续执行下面的分支；父子共享堆页，
+   子进程写入时复制出私有页，父进程看到的内容不变 */
+static void fork_demo(void) {
+    struct proc *p = myproc();
+    long heap = do_syscall(SYS_sbrk, PGSIZE, 0, 0);
+    if (heap == -1) return;
+    uint64 v = 0x1111;
+    copyout(p, heap, &v, sizeof(v));
+    /* 以整数保存的栈地址：fork_kstack 分不出指针和整数，子进程里它会被重定位 */
+    volatile uint64 v_addr = (uint64)&v;
+    int before = p->nfault_cow;
+    long r = do_syscall(SYS_fork, 0, 0, 0);
+    if (r == 0) {
+        struct proc *c = myproc();
+        uint64 w = 0x2222, back = 0;
+        copyout(c, heap, &w, sizeof(w));
+        copyin(c, &back, heap, sizeof(back));
+        printf("[child] pid=%ld fork returned 0, heap=%lx cow faults=%d\n",
+               do_syscall(SYS_getpid, 0, 0, 0), (unsigned long)back, c->nfault_cow);
+        printf("[child] stack address kept as an integer: %s (should be relocated)\n",
+               v_addr == (uint64)&v ? "relocated" : "unchanged");
+        do_syscall(SYS_exit, back == 0x2222 ? 7 : 1, 0, 0);
+    }
+    if (r < 0) {
+        printf("demo: fork failed: returned %ld\n", r);
+        return;
+    }
+    int status = -1;
+    long w = do_syscall(SYS_waitpid, r, (long)&status, 0);
+    uint64 back = 0;
+    copyin(p, &back, heap, sizeof(back));
+    printf("[parent] fork returned %ld, waitpid returned %ld status=%d (should be 7), heap=%lx (should be 1111)\n",
+           r, w, status, (unsigned long)back);
+    printf("[parent] cow faults in parent: %d (should be 0)\n", p->nfault_cow - before);
+    do_syscall(SYS_sbrk, -PGSIZE, 0, 0);
+}
+
+/* 长睡眠中被杀死：定时器挂在它自己的栈上，必须由它醒来后撤销再退出 */
+static void sleeper_child(void) {
+    do_syscall(SYS_nanosleep, 1000000000L / MTIME_FREQ * TICK_INTERVAL * 1000, 0, 0);
+    exit_process(0);
+}
+
+static void kill_demo(void) {
+    int status = 0;
+    int pid = spawn_child(sleeper_child);
+    if (pid < 0) return;
+    demo_nap();
+    long k = do_syscall(SYS_kill, pid, 0, 0);
+    long r = do_syscall(SYS_waitpid, pid, (long)&status, 0);
+    printf("demo: kill(%d) of a sleeper returned %ld, waitpid returned %ld status=%d (should be 0, %d, -1)\n",
+           pid, k, r, status, pid);
+}
+
+/* 演示进程 */
+static void demo_task(void) {
+    /* 等待短时间以保证前面实验输出完成（一个节拍，睡在内核定时器上） */
+    do_syscall(SYS_nanosleep, 1000000000L / MTIME_FREQ * TICK_INTERVAL, 0, 0);
 
     printf("=== syscall demo: start ===\n");
 
@@ -64,7 +266,7 @@ static void demo_task(void) {
 
     // 测试4: 无效地址保护
     long bad = do_syscall(SYS_write, 1, 0x1000000, 10);
-    printf("demo: SYS_write(bad ptr) returned %ld (should be -1)\n", bad);
+    printf("demo: SYS_write(bad ptr) returned %ld (should be -EFAULT)\n", bad);
 
     // 测试5: 无效文件描述符
     long bad_fd = do_syscall(SYS_write, 99, (long)msg, strlen_local(msg));
@@ -74,26 +276,93 @@ static void demo_task(void) {
     long zero = do_syscall(SYS_write, 1, (long)msg, 0);
     printf("demo: SYS_write(zero len) returned %ld (should be 0)\n", zero);
 
-    // 测试7: fork系统调用（当前先关闭，避免大量重复输出）
-#if 0
-    printf("\n=== Testing fork ===\n");
-    long fork_ret = do_syscall(SYS_fork, 0, 0, 0);
-    if (fork_ret == 0) {
-        // 子进程
-        printf("[child] pid=%ld, fork returned 0\n", do_syscall(SYS_getpid, 0, 0, 0));
-        do_syscall(SYS_exit, 0, 0, 0);  // 子进程退出
-    } else if (fork_ret > 0) {
-        // 父进程
-        printf("[parent] pid=%ld, fork returned child_pid=%ld\n", 
-               do_syscall(SYS_getpid, 0, 0, 0), fork_ret);
-        // 等待子进程
-        int status;
-        long waited_pid = do_syscall(SYS_wait, (long)&status, 0, 0);
-        printf("[parent] waited for child pid=%ld, exit status=%d\n", waited_pid, status);
-    } else {
-        printf("fork failed: returned %ld\n", fork_ret);
+    // 测试7: fork系统调用：子进程从 fork 返回 0，写共享的堆页触发写时复制
+    fork_demo();
+
+    /* 跟踪点：只对 getpid 打开一次 */
+    do_syscall(SYS_trace, 1L << SYS_getpid, 0, 0);
+    do_syscall(SYS_getpid, 0, 0, 0);
+    do_syscall(SYS_trace, 0, 0, 0);
+
+    /* 没有子进程：WNOHANG 的 waitpid 也应立即返回 -1 */
+    long wp = do_syscall(SYS_waitpid, -1, 0, WNOHANG);
+    printf("demo: SYS_waitpid(-1, WNOHANG) returned %ld (should be -1, no children)\n", wp);
+
+    /* 调度优先级：合法范围内成功，越界返回 -1 */
+    long pr_ok = do_syscall(SYS_setpriority, 0, 5, 0);
+    long pr_bad = do_syscall(SYS_setpriority, 0, 40, 0);
+    printf("demo: SYS_setpriority(0, 5) returned %ld, (0, 40) returned %ld (should be -1)\n", pr_ok, pr_bad);
+
+    /* 提交/完成环：先单独打开文件拿到 fd，再一次 ring_enter 批量提交写、关闭 */
+    struct ring *r = (struct ring*)do_syscall(SYS_ring_setup, 0, 0, 0);
+    if ((long)r != -1) {
+        const char *rmsg = "written through the ring\n";
+        struct ring_sqe *e = &r->sq[r->sq_tail & (RING_ENTRIES - 1)];
+        e->opcode = RING_OP_OPEN;
+        e->addr = (uint64)"ringdemo";
+        e->op_flags = O_CREATE | O_RDWR;
+        e->user_data = 1;
+        r->sq_tail++;
+        do_syscall(SYS_ring_enter, 1, 0, 0);
+        int rfd = (int)r->cq[r->cq_head++ & (RING_ENTRIES - 1)].res;
+
+        e = &r->sq[r->sq_tail & (RING_ENTRIES - 1)];
+        e->opcode = RING_OP_WRITE;
+        e->fd = rfd;
+        e->addr = (uint64)rmsg;
+        e->len = strlen_local(rmsg);
+        e->user_data = 2;
+        r->sq_tail++;
+        e = &r->sq[r->sq_tail & (RING_ENTRIES - 1)];
+        e->opcode = RING_OP_CLOSE;
+        e->fd = rfd;
+        e->user_data = 3;
+        r->sq_tail++;
+        long n = do_syscall(SYS_ring_enter, 2, 0, 0);
+        printf("demo: SYS_ring_enter submitted %ld (open fd=%d)\n", n, rfd);
+        while (r->cq_head != r->cq_tail) {
+            struct ring_cqe *c = &r->cq[r->cq_head++ & (RING_ENTRIES - 1)];
+            printf("demo: ring cqe user_data=%lu res=%ld\n", (unsigned long)c->user_data, (long)c->res);
+        }
+    }
+
+    /* 用户地址：读进刚扩展的堆（copyout 按缺页装入），再从堆写到控制台（copyin 查页表） */
+    long heap = do_syscall(SYS_sbrk, PGSIZE, 0, 0);
+    long hfd = do_syscall(SYS_open, (long)"ringdemo", O_RDONLY, 0);
+    if (heap != -1 && hfd >= 0) {
+        long n = do_syscall(SYS_read, hfd, heap, 64);
+        printf("demo: SYS_read into heap %p returned %ld: ", (void*)heap, n);
+        do_syscall(SYS_write, 1, heap, n);
+        /* 堆外的用户地址没有 VMA：-EFAULT */
+        long bad_va = do_syscall(SYS_write, 1, USERBASE + 1024L * PGSIZE, 8);
+        printf("demo: SYS_write from unmapped user page returned %ld (should be -EFAULT)\n", bad_va);
+        /* 内核数据不是本进程的缓冲区：-EFAULT，不会改写 ticks */
+        long bad_k = do_syscall(SYS_read, hfd, (long)&ticks, 8);
+        printf("demo: SYS_read into kernel data returned %ld (should be -EFAULT)\n", bad_k);
+        do_syscall(SYS_close, hfd, 0, 0);
+    }
+
+    /* 只读数据页：pid 与 SYS_getpid 一致，时间不陷入内核 */
+    printf("demo: vdso pid=%d (SYS_getpid %ld) ticks=%lu uptime=%lums switches(hart0)=%lu\n",
+           vdso_getpid(), do_syscall(SYS_getpid, 0, 0, 0), (unsigned long)vdso_ticks(),
+           (unsigned long)(vdso_uptime_ns() / 1000000), (unsigned long)vdso->cpu[0].nswitch);
+
+    /* 内存统计 */
+    struct pmm_stats st;
+    if (do_syscall(SYS_meminfo, (long)&st, 0, 0) == 0) {
+        printf("demo: SYS_meminfo used=%lu free=%lu peak=%lu pages\n",
+               (unsigned long)st.used, (unsigned long)st.free, (unsigned long)st.peak);
     }
-#endif
+    do_syscall(SYS_meminfo, 0, 0, 0);
+    herd_demo();
+    swap_demo();
+    mmap_demo();
+    waitpid_demo();
+    kill_demo();
+    wait_dump();
+    tickless_dump();
+    kstack_dump();
+    syscall_stats_dump();
 
     printf("=== syscall demo: basic tests passed ===\n");
 
@@ -0,0 +1,127 @@
+#include "riscv.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "trap.h"
+#include "memlayout.h"
+#include "proc.h"
+
+/* 挂起的定时器按 expires 组成的最小堆，堆顶最早到期；
+   running 记录各 hart 正在执行回调的定时器，timer_cancel 据此等待回调结束 */
+static struct {
+    struct ktimer *heap[NTIMER];
+    int n;
+    struct ktimer *running[NCPU];
+    struct spinlock lock;
+} timers = { .lock = SPINLOCK_INIT("timer") };
+
+static void heap_set(int i, struct ktimer *t) {
+    timers.heap[i] = t;
+    t->index = i;
+}
+
+static void heap_sift_up(int i) {
+    struct ktimer *t = timers.heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (timers.heap[parent]->expires <= t->expires) break;
+        heap_set(i, timers.heap[parent]);
+        i = parent;
+    }
+    heap_set(i, t);
+}
+
+static void heap_sift_down(int i) {
+    struct ktimer *t = timers.heap[i];
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= timers.n) break;
+        if (c + 1 < timers.n && timers.heap[c + 1]->expires < timers.heap[c]->expires) c++;
+        if (t->expires <= timers.heap[c]->expires) break;
+        heap_set(i, timers.heap[c]);
+        i = c;
+    }
+    heap_set(i, t);
+}
+
+/* 从堆中删除下标 i 的定时器（需持有 timers.lock） */
+static void heap_remove(int i) {
+    struct ktimer *t = timers.heap[i];
+    t->index = -1;
+    if (--timers.n == i) return;
+    /* 用最后一个元素填补空位，它可能需要下沉也可能需要上浮 */
+    struct ktimer *last = timers.heap[timers.n];
+    heap_set(i, last);
+    heap_sift_down(i);
+    heap_sift_up(last->index);
+}
+
+void timer_init(struct ktimer *t, void (*fn)(void *arg), void *arg) {
+    t->expires = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->index = -1;
+}
+
+int timer_add(struct ktimer *t, uint64_t expires) {
+    acquire(&timers.lock);
+    if (t->index >= 0) heap_remove(t->index);
+    if (timers.n == NTIMER) {
+        release(&timers.lock);
+        return -1;
+    }
+    t->expires = expires;
+    heap_set(timers.n++, t);
+    heap_sift_up(t->index);
+    int earliest = t->index == 0;
+    release(&timers.lock);
+    /* 成了最早的定时器：本 hart 的 mtimecmp 提前到它的截止时间 */
+    if (earliest) timer_rearm();
+    return 0;
+}
+
+/* t 的回调是否正在其他 hart 上执行（需持有 timers.lock）；回调里取消自己不用等 */
+static int running_elsewhere(struct ktimer *t) {
+    for (int i = 0; i < NCPU; i++) {
+        if (i != cpuid() && timers.running[i] == t) return 1;
+    }
+    return 0;
+}
+
+int timer_cancel(struct ktimer *t) {
+    acquire(&timers.lock);
+    int pending = t->index >= 0;
+    if (pending) heap_remove(t->index);
+    /* 已到期、回调还在执行：等它返回，之后调用者才能释放 t（比如栈上的定时器） */
+    while (running_elsewhere(t)) {
+        release(&timers.lock);
+        acquire(&timers.lock);
+    }
+    release(&timers.lock);
+    return pending;
+}
+
+uint64_t timer_next_deadline(void) {
+    acquire(&timers.lock);
+    uint64_t d = timers.n ? timers.heap[0]->expires : ~0ULL;
+    release(&timers.lock);
+    return d;
+}
+
+void timer_run(uint64_t now) {
+    int id = cpuid();
+    acquire(&timers.lock);
+    while (timers.n && timers.heap[0]->expires <= now) {
+        struct ktimer *t = timers.heap[0];
+        heap_remove(0);
+        /* fn/arg 在锁内取出；回调结束前 timer_cancel 不会返回，t 一直有效 */
+        void (*fn)(void *arg) = t->fn;
+        void *arg = t->arg;
+        timers.running[id] = t;
+        release(&timers.lock);
+        /* 回调可能再次 timer_add 或拿其他锁（如 proc_lock），不能持有 timers.lock */
+        fn(arg);
+        acquire(&timers.lock);
+        timers.running[id] = 0;
+    }
+    release(&timers.lock);
+}
@@ -4,49 +4,139 @@
 #include "printf.h"
 #include "uart.h"
 #include "syscall.h"
+#include "proc.h"
+#include "vmm.h"
+#include "timer.h"
+#include "vdso.h"
 
 volatile uint64 ticks = 0;
 
-static void timer_set_next(uint64 interval){
-    uint64 hart = r_mhartid();
-    uint64 now = clint_read64(CLINT_MTIME);
-    clint_write64(CLINT_MTIMECMP(hart), now + interval);
+/* 启动时的 mtime：全局节拍数由 mtime 推算，哪个 hart 先越过节拍边界就由它推进，
+   启动 hart 长时间无节拍空闲时 ticks 也不会停住 */
+static uint64 tick_base;
+
+/* 各 hart 下一个周期节拍的 mtime：节拍按固定边界推进，中断来晚或空闲期间跳过的节拍都能按 mtime 补齐 */
+static uint64 next_tick[NCPU];
+
+/* 无节拍空闲统计（每个 hart 只改自己的一项） */
+static struct {
+    uint64 idle_enters;       /* 进入无节拍空闲的次数 */
+    uint64 ticks_skipped;     /* 空闲期间没有产生中断、醒来后一次补上的节拍数 */
+    uint64 ipis;              /* 被软件中断唤醒的次数 */
+} tickless[NCPU];
+
+static void timer_arm(uint64 when){
+    clint_write64(CLINT_MTIMECMP(cpuid()), when);
+}
+
+/* 全局节拍推进到 now 对应的值；各 hart 并发调用，只会变大。
+   CAS 成功的 hart 负责发布到 vdso 数据页，多个 hart 的发布由 vdso_set_ticks 加锁串行化 */
+static void ticks_advance(uint64 now){
+    uint64 t = (now - tick_base) / TICK_INTERVAL;
+    uint64 old = ticks;
+    while (old < t) {
+        if (__atomic_compare_exchange_n((uint64*)&ticks, &old, t, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            vdso_set_ticks(t);
+            break;
+        }
+    }
 }
 
+/* 推进本 hart 的节拍边界到 now 之后，返回经过的节拍数 */
+static uint64 tick_catch_up(uint64 now){
+    int id = cpuid();
+    if (now < next_tick[id]) return 0;
+    uint64 n = (now - next_tick[id]) / TICK_INTERVAL + 1;
+    next_tick[id] += n * TICK_INTERVAL;
+    ticks_advance(now);
+    return n;
+}
+
+void timer_rearm(void){
+    uint64 when = next_tick[cpuid()];
+    uint64 d = timer_next_deadline();
+    timer_arm(d < when ? d : when);
+}
+
+/* 时钟中断可能是节拍，也可能只是某个内核定时器到期（比节拍更细的精度） */
 static void timer_interrupt(void){
-    ticks++;
-    timer_set_next(TICK_INTERVAL);
+    uint64 now = get_time();
+    timer_run(now);
+    uint64 n = tick_catch_up(now);
+    timer_rearm();
+    /* 时间片轮转：可能在这里切换到其他进程，恢复运行后由 mti_entry 从栈上的帧返回 */
+    if (n) proc_tick();
+}
+
+/* 空闲时的截止时间：最早的内核定时器，最多 TICK_IDLE_MAX 个节拍 */
+static uint64 idle_deadline(uint64 now){
+    uint64 d = timer_next_deadline();
+    uint64 max = now + TICK_IDLE_MAX * TICK_INTERVAL;
+    return d < max ? d : max;
+}
+
+void timer_idle_enter(void){
+    tickless[cpuid()].idle_enters++;
+    vdso_idle();
+    timer_arm(idle_deadline(get_time()));
+}
+
+void timer_idle_exit(void){
+    /* 醒来的原因可能是截止时间到、IPI 或其他中断；重新设置 mtimecmp 会清掉挂起的定时器中断，
+       所以到期的定时器在这里直接运行 */
+    uint64 now = get_time();
+    timer_run(now);
+    tickless[cpuid()].ticks_skipped += tick_catch_up(now);
+    timer_rearm();
+}
+
+void tickless_dump(void){
+    for (int i = 0; i < NCPU; i++) {
+        if (tickless[i].idle_enters == 0) continue;
+        printf("tickless: hart %d idle=%lu ticks skipped=%lu ipi wakeups=%lu\n", i,
+               (unsigned long)tickless[i].idle_enters, (unsigned long)tickless[i].ticks_skipped,
+               (unsigned long)tickless[i].ipis);
+    }
+}
+
+void ipi_send(int hart){
+    clint_write32(CLINT_MSIP(hart), 1);
+}
+
+/* 以下由 kernelvec.S 的向量入口直接调用（只保存了调用者保存寄存器） */
+
+void timer_trap(void){
+    timer_interrupt();
+}
+
+void soft_trap(void){
+    /* 其他 hart 入队了进程：清除后回到调度器循环 */
+    clint_write32(CLINT_MSIP(cpuid()), 0);
+    tickless[cpuid()].ipis++;
+}
+
+void external_trap(void){
+    /* 还没有 PLIC 驱动，不应收到外部中断 */
+    printf("Unhandled external interrupt\n");
 }
 
-/* 修改：kerneltrap 接收 saved 指针（由 kernelvec.S 放在 a0） */
+/* 完整保存路径：异常（ecall 除外）和没有专用入口的中断。
+   kerneltrap 接收 saved 指针（由 kernelvec.S 放在 a0） */
 void kerneltrap(uint64 *saved){
     uint64 mcause = r_mcause();
     if (mcause >> 63){
         uint64 code = mcause & 0xfff;
-        if (code == 7){
-            timer_interrupt();
-            return;
-        }
         printf("Unhandled interrupt: code=%lu\n", (unsigned long)code);
         return;
     } else {
         uint64 cause = mcause & 0xfff;
-        if (cause == 11) { /* ecall from M-mode */
-            /* DEBUG: dump saved a0..a7 before dispatch */
-            printf("[dbg] saved[8..15]:");
-            for (int i = 8; i <= 15; i++) {
-                printf(" %llx", (unsigned long long)saved[i]);
-            }
-            printf("\n");
-
-            /* 调用系统调用分发器 */
-            handle_syscall(saved);
-
-            /* DEBUG: dump returned a0 */
-            printf("[dbg] after handle, saved[8]=%llx\n", (unsigned long long)saved[8]);
-
-            /* advance mepc to skip ecall */
-            w_mepc(r_mepc() + 4);
+
+        /* 取指/读/写缺页：交给 VM 缺页处理（按需分配、文件映射、写时复制），
+           成功则返回并重新执行该指令。进程目前运行在 M 态，访存不经 satp 翻译，
+           不会走到这里：用户地址只经 copyin/copyout（user_pa）访问，缺页在那里处理。
+           这条路径留给将来在 S/U 态运行的进程 */
+        if ((cause == 12 || cause == 13 || cause == 15) && myproc() &&
+            vm_fault(myproc(), r_mtval(), cause == 15 ? FAULT_WRITE : cause == 12 ? FAULT_EXEC : 0) == 0) {
             return;
         }
 
@@ -62,17 +152,29 @@ uint64 get_time(void){
     return clint_read64(CLINT_MTIME);
 }
 
-void trap_init(void){
-    extern void kernelvec(void);
+/* 本 hart 的陷阱与时钟初始化：启动 hart 由 trap_init 调用，其余 hart 在 mpmain 中调用 */
+void trap_inithart(void){
+    extern void trapvec(void);
+
+    // 设置 M-mode 陷阱向量：向量模式（低两位为 1），中断按 mcause 跳到各自的入口
+    w_mtvec((uint64)trapvec | 1);
 
-    // 设置 M-mode 陷阱向量（保留 M-mode 入口）
-    w_mtvec((uint64)kernelvec);
+    // 还没有进程：陷阱保存在当前栈上
+    w_mscratch(0);
 
     // 先设置第一次定时器触发点，再开中断
-    timer_set_next(TICK_INTERVAL);
+    next_tick[cpuid()] = get_time() + TICK_INTERVAL;
+    timer_arm(next_tick[cpuid()]);
 
-    // 使能M态定时器中断
-    set_mie(MIE_MTIE);
+    // 使能M态定时器中断和软件中断（IPI）
+    clint_write32(CLINT_MSIP(cpuid()), 0);
+    set_mie(MIE_MTIE | MIE_MSIE);
     // 开启全局M态中断
     set_mstatus(MSTATUS_MIE);
-}
\ No newline at end of file
+}
+
+void trap_init(void){
+    tick_base = get_time();
+    vdso_init();
+    trap_inithart();
+}
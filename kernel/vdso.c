@@ -0,0 +1,48 @@
+#include "riscv.h"
+#include "memlayout.h"
+#include "proc.h"
+#include "trap.h"
+#include "spinlock.h"
+#include "vdso.h"
+
+/* 独占一页：进程和内核共用一个地址空间，直接把这一页的地址交给进程，只读由 const 指针约定 */
+static struct vdso_data vdso_page __attribute__((aligned(PGSIZE)));
+
+const struct vdso_data *const vdso = &vdso_page;
+
+static struct spinlock vdso_lock = SPINLOCK_INIT("vdso");
+
+void vdso_init(void) {
+    vdso_page.ncpu = NCPU;
+    vdso_page.mtime_freq = MTIME_FREQ;
+    vdso_page.tick_interval = TICK_INTERVAL;
+    vdso_page.mtime_base = get_time();
+    vdso_page.ticks = ticks;
+}
+
+/* 各 hart 都可能推进节拍：写者之间用锁互斥，只写更大的值 */
+void vdso_set_ticks(uint64_t t) {
+    acquire(&vdso_lock);
+    if (t > vdso_page.ticks) {
+        vdso_page.seq++;
+        __sync_synchronize();
+        vdso_page.ticks = t;
+        __sync_synchronize();
+        vdso_page.seq++;
+    }
+    release(&vdso_lock);
+}
+
+void vdso_set_current(int pid) {
+    struct vdso_cpu *c = &vdso_page.cpu[cpuid()];
+    c->seq++;
+    __sync_synchronize();
+    c->pid = pid;
+    if (pid) c->nswitch++;
+    __sync_synchronize();
+    c->seq++;
+}
+
+void vdso_idle(void) {
+    vdso_page.cpu[cpuid()].nidle++;
+}
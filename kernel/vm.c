@@ -3,6 +3,11 @@
 #include "printf.h"
 #include "pmm.h"
 #include "vmm.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "zram.h"
+#include "errno.h"
 
 /* 外部符号 */
 extern char etext[]; // 内核代码段结束地址
@@ -10,62 +15,99 @@ extern char etext[]; // 内核代码段结束地址
 /* 内核页表 */
 pagetable_t kernel_pagetable;
 
-/* 遍历页表，查找给定虚拟地址对应的PTE。如果不存在且alloc为1，则创建。*/
-static pte_t* walk(pagetable_t pagetable, uint64_t va, int alloc) {
+/* 页表页计数及各级叶子映射数（启动统计） */
+static uint64_t pt_pages = 0;
+static uint64_t nmap[3] = {0, 0, 0};
+
+/* 遍历页表，返回 va 在第 level 级的 PTE。中间级不存在且 alloc 为1时创建；
+   若途中遇到更高一级的叶子（大页）则返回0 */
+static pte_t* walk_level(pagetable_t pagetable, uint64_t va, int level, int alloc) {
     if (va >= (1L << 39)) { // Sv39虚拟地址不能超过39位
         return 0;
     }
 
-    for (int level = 2; level > 0; level--) {
-        pte_t *pte = &pagetable[VPN(va, level)];
+    for (int l = 2; l > level; l--) {
+        pte_t *pte = &pagetable[VPN(va, l)];
         if (*pte & PTE_V) {
+            if (PTE_LEAF(*pte)) {
+                return 0; // 已被大页覆盖
+            }
             pagetable = (pagetable_t)PTE2PA(*pte);
         } else {
+            // alloc_page() 返回的页已清零
             if (!alloc || (pagetable = (pagetable_t)alloc_page()) == 0) {
                 return 0;
             }
-            // 清空新分配的页表页
-            for(int i = 0; i < PGSIZE / sizeof(pte_t); i++) pagetable[i] = 0;
+            pmm_set_tag(pagetable, PMM_TAG_PGTBL);
+            pt_pages++;
             *pte = PA2PTE((uint64_t)pagetable) | PTE_V; 
         }
     }
-    return &pagetable[VPN(va, 0)];
+    return &pagetable[VPN(va, level)];
+}
+
+/* 遍历页表，查找给定虚拟地址对应的 4KB 级PTE。如果不存在且alloc为1，则创建。*/
+static pte_t* walk(pagetable_t pagetable, uint64_t va, int alloc) {
+    return walk_level(pagetable, va, 0, alloc);
+}
+
+/* 查找映射 va 的叶子PTE，遇到大页即停止；level 返回叶子所在级（0/1/2） */
+pte_t* walk_leaf(pagetable_t pagetable, uint64_t va, int *level) {
+    if (va >= (1L << 39)) {
+        return 0;
+    }
+    for (int l = 2; l >= 0; l--) {
+        pte_t *pte = &pagetable[VPN(va, l)];
+        if (!(*pte & PTE_V)) {
+            return 0;
+        }
+        if (PTE_LEAF(*pte) || l == 0) {
+            if (level) *level = l;
+            return pte;
+        }
+        pagetable = (pagetable_t)PTE2PA(*pte);
+    }
+    return 0;
 }
 
-/* 映射一个页面 */
-static int map_page(pagetable_t pagetable, uint64_t va, uint64_t pa, int perm) {
-    if ((va % PGSIZE) != 0 || (pa % PGSIZE) != 0) {
-        return -1; // 地址必须页对齐
+/* 在第 level 级映射一个页面（level 1/2 为 2MB/1GB 大页） */
+static int map_page(pagetable_t pagetable, uint64_t va, uint64_t pa, int perm, int level) {
+    if ((va % LEVEL_SIZE(level)) != 0 || (pa % LEVEL_SIZE(level)) != 0) {
+        return -1; // 地址必须按页大小对齐
     }
 
-    pte_t *pte = walk(pagetable, va, 1);
+    pte_t *pte = walk_level(pagetable, va, level, 1);
     if (pte == 0) {
-        return -1; // 内存不足
+        return -1; // 内存不足或已被大页覆盖
     }
     if (*pte & PTE_V) {
         printf("map_page: remap\n");
         return -1; // 已被映射
     }
     *pte = PA2PTE(pa) | perm | PTE_V;
+    nmap[level]++;
     return 0;
 }
 
-/* 映射一个内存区域 */
+/* 映射一个内存区域：对齐和剩余长度允许时自动使用 1GB/2MB 大页 */
 int map_region(pagetable_t pt, uint64_t va, uint64_t pa, uint64_t size, int perm) {
-    uint64_t a, last;
+    uint64_t a, end;
 
     a = PGROUNDDOWN(va);
-    last = PGROUNDDOWN(va + size - 1);
+    end = PGROUNDDOWN(va + size - 1) + PGSIZE;
 
-    for (;;) {
-        if (map_page(pt, a, pa, perm) != 0) {
-            return -1;
+    while (a < end) {
+        int level = 2;
+        while (level > 0 &&
+               ((a % LEVEL_SIZE(level)) != 0 || (pa % LEVEL_SIZE(level)) != 0 ||
+                end - a < LEVEL_SIZE(level))) {
+            level--;
         }
-        if (a == last) {
-            break;
+        if (map_page(pt, a, pa, perm, level) != 0) {
+            return -1;
         }
-        a += PGSIZE;
-        pa += PGSIZE;
+        a += LEVEL_SIZE(level);
+        pa += LEVEL_SIZE(level);
     }
     return 0;
 }
@@ -74,7 +116,8 @@ int map_region(pagetable_t pt, uint64_t va, uint64_t pa, uint64_t size, int perm
 pagetable_t create_pagetable(void) {
     pagetable_t pagetable = (pagetable_t)alloc_page();
     if (pagetable == 0) return 0;
-    for(int i = 0; i < PGSIZE / sizeof(pte_t); i++) pagetable[i] = 0;
+    pmm_set_tag(pagetable, PMM_TAG_PGTBL);
+    pt_pages++;
     return pagetable;
 }
 
@@ -120,13 +163,605 @@ void kvminit(void) {
         }
     }
 
-    printf("kvminit: kernel page table created.\n");
+    printf("kvminit: kernel page table created (%lu page-table pages; mappings 4K=%lu 2M=%lu 1G=%lu).\n",
+           (unsigned long)pt_pages, (unsigned long)nmap[0], (unsigned long)nmap[1], (unsigned long)nmap[2]);
 }
 
-/* 激活内核页表 */
+/* ASID 分配：内核页表固定使用 ASID 0，进程从 1 开始顺序分配；
+   用尽后代数加一并整体刷新 TLB，旧代数的 ASID 在下次切换时重新分配 */
+static struct {
+    uint64_t max;     /* 实现支持的最大 ASID，0 表示不支持 ASID */
+    uint64_t gen;     /* 当前代数，从 1 开始 */
+    uint64_t next;    /* 本代下一个可分配的 ASID */
+    uint64_t rollovers;
+    struct spinlock lock;
+    uint64_t flushed_gen[NCPU];   /* 各 hart 已刷新到的代数：换代后每个 hart 各自整体刷新一次 */
+} asid = { 0, 1, 1, 0, SPINLOCK_INIT("asid") };
+
+/* 探测实现支持的 ASID 位数：向 ASID 字段写全 1 后读回 */
+static void asid_init(void) {
+    w_satp(MAKE_SATP_ASID(kernel_pagetable, SATP_ASID_MASK));
+    asid.max = (r_satp() >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+    asid.gen = 1;
+    asid.next = 1;
+}
+
+/* 激活内核页表（每个 hart 调用一次，ASID 探测只在启动 hart 上做） */
 void kvminithart(void) {
-    printf("kvminithart: activating kernel page table...\n");
-    w_satp((((uint64_t)kernel_pagetable) >> 12) | (8L << 60));
+    if (cpuid() == 0) {
+        printf("kvminithart: activating kernel page table...\n");
+        asid_init();
+    }
+    w_satp(MAKE_SATP(kernel_pagetable));
     sfence_vma();
-    printf("kvminithart: paging enabled.\n");
-}
\ No newline at end of file
+    asid.flushed_gen[cpuid()] = asid.gen;
+    printf("kvminithart: hart %d paging enabled (max ASID %lu).\n", cpuid(), (unsigned long)asid.max);
+}
+
+/* 切换到进程 p 的地址空间（p 为 0 时切回内核页表）。
+   ASID 仍属当前代时不需要刷新 TLB */
+void vm_activate(struct proc *p) {
+    if (p == 0) {
+        w_satp(MAKE_SATP(kernel_pagetable));
+        if (asid.max == 0) sfence_vma();
+        return;
+    }
+    if (asid.max == 0) {
+        w_satp(MAKE_SATP(p->pagetable));
+        sfence_vma();
+        return;
+    }
+    acquire(&asid.lock);
+    if (p->asid_gen != asid.gen) {
+        if (asid.next > asid.max) {
+            asid.gen++;
+            asid.next = 1;
+            asid.rollovers++;
+        }
+        p->asid = asid.next++;
+        p->asid_gen = asid.gen;
+    }
+    /* 换代后本 hart 的 TLB 里可能还有旧代同号 ASID 的项 */
+    if (asid.flushed_gen[cpuid()] != asid.gen) {
+        asid.flushed_gen[cpuid()] = asid.gen;
+        sfence_vma();
+    }
+    w_satp(MAKE_SATP_ASID(p->pagetable, p->asid));
+    release(&asid.lock);
+}
+
+/* 进程当前有效的 ASID；没有（未分配或已过期）返回 0 */
+uint64_t proc_asid(struct proc *p) {
+    if (p == 0 || asid.max == 0 || p->asid_gen != asid.gen) return 0;
+    return p->asid;
+}
+
+/* 刷新单个页的 TLB 项：有 ASID 时只刷该地址空间，否则刷该地址的所有项 */
+static void tlb_flush_page(uint64_t va, uint64_t as) {
+    if (as) sfence_vma_va_asid(va, as);
+    else sfence_vma_va(va);
+}
+
+/* 刷新一段地址：页数较多时直接刷新整个 ASID */
+#define TLB_FLUSH_MAX_PAGES 32
+static void tlb_flush_range(uint64_t start, uint64_t end, uint64_t as) {
+    if ((end - start) / PGSIZE > TLB_FLUSH_MAX_PAGES) {
+        if (as) sfence_vma_asid(as);
+        else sfence_vma();
+        return;
+    }
+    for (uint64_t a = PGROUNDDOWN(start); a < end; a += PGSIZE) {
+        tlb_flush_page(a, as);
+    }
+}
+
+/* ====== 进程地址空间 ====== */
+
+/* 按 8 字节复制一整页 */
+static void page_copy(void *dst, const void *src) {
+    uint64_t *d = (uint64_t*)dst;
+    const uint64_t *s = (const uint64_t*)src;
+    for (int i = 0; i < PGSIZE / sizeof(uint64_t); i++) d[i] = s[i];
+}
+
+/* 创建进程页表：共享内核映射（根页表中 USERBASE 以外的各项），用户区为空 */
+pagetable_t uvm_create(void) {
+    pagetable_t pagetable = create_pagetable();
+    if (pagetable == 0) return 0;
+    for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+        if (i != VPN(USERBASE, 2)) {
+            pagetable[i] = kernel_pagetable[i];
+        }
+    }
+    return pagetable;
+}
+
+/* 在进程页表中映射一个 4KB 用户页。新映射的页视为刚被访问过（PTE_A），
+   换出时的时钟扫描会给它一次机会 */
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, int perm) {
+    if (va < USERBASE || va >= USERTOP) return -1;
+    return map_page(pagetable, va, pa, perm | PTE_U | PTE_A, 0);
+}
+
+/* 为 [oldsz, newsz) 分配清零的物理页并映射为可读写，返回新大小，失败返回 0 */
+uint64_t uvm_alloc(pagetable_t pagetable, uint64_t oldsz, uint64_t newsz) {
+    if (newsz <= oldsz) return oldsz;
+    if (USERBASE + newsz > USERTOP) return 0;
+    for (uint64_t a = PGROUNDUP(oldsz); a < newsz; a += PGSIZE) {
+        void *mem = alloc_page();
+        if (mem == 0 || uvm_map(pagetable, USERBASE + a, (uint64_t)mem, PTE_R | PTE_W) != 0) {
+            if (mem) free_page(mem);
+            uvm_unmap(pagetable, 0, USERBASE + oldsz, USERBASE + a);
+            return 0;
+        }
+        pmm_set_tag(mem, PMM_TAG_USER);
+    }
+    return newsz;
+}
+
+/* 解除 [start, end) 内已建立的映射，释放（或减少引用）对应物理页；未建立映射的页跳过。
+   as 为该页表的 ASID（0 表示未知），用于定向刷新 TLB */
+void uvm_unmap(pagetable_t pagetable, uint64_t as, uint64_t start, uint64_t end) {
+    for (uint64_t a = PGROUNDUP(start); a < end; a += PGSIZE) {
+        pte_t *pte = walk(pagetable, a, 0);
+        if (pte && (*pte & PTE_V)) {
+            free_page((void*)PTE2PA(*pte));
+            *pte = 0;
+        } else if (pte && (*pte & PTE_SWAP)) {
+            zram_free(PTE2SLOT(*pte));
+            *pte = 0;
+        }
+    }
+    tlb_flush_range(PGROUNDUP(start), end, as);
+}
+
+/* 递归释放用户区的页表页及其中仍映射着的叶子页 */
+static void freewalk(pagetable_t pagetable, int level) {
+    for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+        pte_t pte = pagetable[i];
+        if (pte & PTE_V) {
+            if (level > 0 && !PTE_LEAF(pte)) {
+                freewalk((pagetable_t)PTE2PA(pte), level - 1);
+            } else {
+                free_page((void*)PTE2PA(pte));
+            }
+        } else if (level == 0 && (pte & PTE_SWAP)) {
+            zram_free(PTE2SLOT(pte));
+        }
+        pagetable[i] = 0;
+    }
+    free_page(pagetable);
+    pt_pages--;
+}
+
+/* 释放进程页表：用户页、用户区页表页和根页表；共享的内核下级页表不动 */
+void uvm_free(pagetable_t pagetable) {
+    if (pagetable == 0) return;
+    pte_t ue = pagetable[VPN(USERBASE, 2)];
+    if ((ue & PTE_V) && !PTE_LEAF(ue)) {
+        freewalk((pagetable_t)PTE2PA(ue), 1);
+    }
+    free_page(pagetable);
+    pt_pages--;
+}
+
+/* ====== 压缩交换 ====== */
+
+/* 把换出的页解压回新分配的物理页并恢复映射 */
+static int swap_in(pte_t *pte, uint64_t va, uint64_t as) {
+    void *mem = alloc_page_nozero();
+    if (mem == 0) return -1;
+    int slot = PTE2SLOT(*pte);
+    if (zram_load(slot, mem) < 0) {
+        free_page(mem);
+        return -1;
+    }
+    pmm_set_tag(mem, PMM_TAG_USER);
+    *pte = PA2PTE((uint64_t)mem) | (*pte & 0x3FF & ~PTE_SWAP) | PTE_V | PTE_A;
+    zram_free(slot);
+    tlb_flush_page(va, as);
+    return 0;
+}
+
+/* 把独占的用户页压缩存入 zram 并释放物理页；共享页或不可压缩的页返回 -1 */
+static int swap_out(pte_t *pte, uint64_t va, uint64_t as) {
+    uint64_t pa = PTE2PA(*pte);
+    if (pmm_refcount((void*)pa) != 1) return -1;
+    int slot = zram_store((void*)pa);
+    if (slot < 0) return -1;
+    *pte = SWAP_PTE(slot, *pte);
+    tlb_flush_page(va, as);
+    free_page((void*)pa);
+    return 0;
+}
+
+/* 时钟指针：当前扫描的进程槽位和用户虚拟地址 */
+static struct {
+    int slot;
+    uint64_t va;
+} clock_hand = { 0, USERBASE };
+
+/* 内存紧张时由物理页分配器调用：按时钟算法扫描各进程的 4KB 用户页，
+   PTE_A 置位的页清除后跳过（第二次机会），其余换出。返回回收的页数 */
+int vm_reclaim(int target) {
+    int reclaimed = 0;
+    /* 回收由分配失败触发，调用者可能正持有 proc_lock 或某个进程的 vmlock：
+       一律用 try_acquire，拿不到就跳过，而不是在自己持有的锁上死等 */
+    if (!try_acquire(&proc_lock)) return 0;
+    /* 最多绕所有进程两圈：第一圈清除访问位，第二圈换出 */
+    for (int pass = 0; pass < 2 * NPROC && reclaimed < target; pass++) {
+        struct proc *p = proc[clock_hand.slot];
+        if (p && p->state != UNUSED && p->pagetable && try_acquire(&p->vmlock)) {
+            uint64_t as = proc_asid(p);
+            pte_t ue = p->pagetable[VPN(USERBASE, 2)];
+            pagetable_t l1 = (ue & PTE_V) && !PTE_LEAF(ue) ? (pagetable_t)PTE2PA(ue) : 0;
+            for (uint64_t a = clock_hand.va; l1 && a < USERTOP && reclaimed < target; ) {
+                pte_t l1e = l1[VPN(a, 1)];
+                if (!(l1e & PTE_V) || PTE_LEAF(l1e)) {
+                    a = (a + LEVEL_SIZE(1)) & ~(LEVEL_SIZE(1) - 1);
+                    clock_hand.va = a;
+                    continue;
+                }
+                pte_t *pte = &((pagetable_t)PTE2PA(l1e))[VPN(a, 0)];
+                if (*pte & PTE_V) {
+                    if (*pte & PTE_A) {
+                        *pte &= ~PTE_A;
+                        tlb_flush_page(a, as);
+                    } else if (swap_out(pte, a, as) == 0) {
+                        reclaimed++;
+                    }
+                }
+                a += PGSIZE;
+                clock_hand.va = a;
+            }
+            release(&p->vmlock);
+            if (reclaimed >= target) break;
+        }
+        clock_hand.slot = (clock_hand.slot + 1) % NPROC;
+        clock_hand.va = USERBASE;
+    }
+    release(&proc_lock);
+    return reclaimed;
+}
+
+/* fork：子进程共享父进程 [start, end) 内已映射的页，双方的可写页都改为只读 + PTE_COW。
+   old_as 为父进程的 ASID，降级为只读的页在该地址空间中刷新 */
+int uvm_cow_copy(pagetable_t old, uint64_t old_as, pagetable_t new, uint64_t start, uint64_t end) {
+    for (uint64_t a = PGROUNDDOWN(start); a < end; a += PGSIZE) {
+        pte_t *pte = walk(old, a, 0);
+        if (pte == 0 || !(*pte & (PTE_V | PTE_SWAP))) continue;
+        /* 先建好子进程的页表页再换入：分配触发的回收不会动尚未换入的页 */
+        pte_t *npte = walk(new, a, 1);
+        if (npte == 0) {
+            return -1;
+        }
+        if ((*pte & PTE_SWAP) && swap_in(pte, a, old_as) < 0) {
+            return -1;
+        }
+        if (*pte & PTE_W) {
+            *pte = (*pte & ~PTE_W) | PTE_COW;
+        }
+        uint64_t pa = PTE2PA(*pte);
+        *npte = *pte;
+        pmm_incref((void*)pa);
+    }
+    /* 父进程的可写映射已降为只读，旧的 TLB 项必须作废 */
+    tlb_flush_range(PGROUNDDOWN(start), end, old_as);
+    return 0;
+}
+
+/* 写时复制缺页：独占则直接恢复写权限，否则复制一份私有页。成功返回 0 */
+int cow_fault(pagetable_t pagetable, uint64_t as, uint64_t va) {
+    if (va < USERBASE || va >= USERTOP) return -1;
+    pte_t *pte = walk(pagetable, PGROUNDDOWN(va), 0);
+    if (pte == 0 || !(*pte & PTE_V) || !(*pte & PTE_COW)) return -1;
+
+    uint64_t pa = PTE2PA(*pte);
+    int flags = (*pte & 0x3FF & ~PTE_COW) | PTE_W;
+    if (pmm_refcount((void*)pa) == 1) {
+        *pte = PA2PTE(pa) | flags;
+    } else {
+        void *mem = alloc_page_nozero();
+        if (mem == 0) return -1;
+        pmm_set_tag(mem, PMM_TAG_USER);
+        page_copy(mem, (void*)pa);
+        *pte = PA2PTE((uint64_t)mem) | flags;
+        free_page((void*)pa);
+    }
+    tlb_flush_page(PGROUNDDOWN(va), as);
+    return 0;
+}
+/* ====== 虚拟内存区域（VMA）与缺页处理 ====== */
+
+/* 查找包含 va 的 VMA */
+struct vma *vma_find(struct proc *p, uint64_t va) {
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vma[i];
+        if (v->type != VMA_NONE && va >= v->start && va < v->end) return v;
+    }
+    return 0;
+}
+
+/* 添加一个 VMA，返回其指针；槽位用尽返回 0 */
+struct vma *vma_add(struct proc *p, uint64_t start, uint64_t end, int perm, int type) {
+    for (int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vma[i];
+        if (v->type == VMA_NONE) {
+            v->start = start;
+            v->end = end;
+            v->perm = perm;
+            v->type = type;
+            v->fid = -1;
+            v->off = 0;
+            return v;
+        }
+    }
+    return 0;
+}
+
+/* 新进程的地址空间：空堆 + 栈区，均在首次访问时才分配物理页 */
+void proc_vm_init(struct proc *p) {
+    for (int i = 0; i < NVMA; i++) p->vma[i].type = VMA_NONE;
+    p->sz = 0;
+    p->mmap_top = USERMMAP;
+    p->nfault_anon = p->nfault_file = p->nfault_cow = p->nfault_swap = 0;
+    vma_add(p, USERBASE, USERBASE, PTE_R | PTE_W, VMA_HEAP);
+    vma_add(p, USTACK_BOTTOM, USERTOP, PTE_R | PTE_W, VMA_STACK);
+}
+
+/* 进程释放时撤销所有 VMA，归还文件映射持有的文件引用（页表由 uvm_free 释放） */
+void proc_vm_free(struct proc *p) {
+    for (int i = 0; i < NVMA; i++) {
+        if (p->vma[i].type == VMA_FILE) fs_file_put(p->vma[i].fid);
+        p->vma[i].type = VMA_NONE;
+    }
+}
+
+/* fork：复制 VMA 描述，并以写时复制方式共享其中已建立的页。
+   先锁父进程再锁子进程（子进程尚未可运行，不会反向加锁） */
+int proc_vm_fork(struct proc *p, struct proc *np) {
+    int r = 0;
+    acquire(&p->vmlock);
+    acquire(&np->vmlock);
+    for (int i = 0; i < NVMA; i++) {
+        np->vma[i] = p->vma[i];
+        struct vma *v = &p->vma[i];
+        if (v->type == VMA_NONE) continue;
+        if (v->type == VMA_FILE) fs_file_dup(v->fid);
+        if (uvm_cow_copy(p->pagetable, proc_asid(p), np->pagetable, v->start, v->end) < 0) {
+            r = -1;
+            break;
+        }
+    }
+    np->sz = p->sz;
+    np->mmap_top = p->mmap_top;
+    release(&np->vmlock);
+    release(&p->vmlock);
+    return r;
+}
+
+/* 堆边界随 sbrk 调整：只改 VMA，收缩时解除映射，增长时不分配物理页 */
+int proc_vm_setbrk(struct proc *p, uint64_t newsz) {
+    struct vma *heap = 0;
+    acquire(&p->vmlock);
+    for (int i = 0; i < NVMA; i++) {
+        if (p->vma[i].type == VMA_HEAP) heap = &p->vma[i];
+    }
+    if (heap == 0 || USERBASE + newsz > USERMMAP) {
+        release(&p->vmlock);
+        return -1;
+    }
+    if (newsz < p->sz) {
+        uvm_unmap(p->pagetable, proc_asid(p), USERBASE + newsz, USERBASE + PGROUNDUP(p->sz));
+    }
+    heap->end = USERBASE + PGROUNDUP(newsz);
+    p->sz = newsz;
+    release(&p->vmlock);
+    return 0;
+}
+
+/* 文件映射：把 fd 对应文件的前 len 字节私有映射到 mmap 区，返回起始地址。
+   VMA 持有文件引用，关闭 fd 或删除文件后映射仍读到原文件，引用在 proc_vm_free 中释放 */
+uint64_t proc_vm_mmap_file(struct proc *p, int fd, uint64_t len, int perm) {
+    if (len == 0) return 0;
+    int fid = fs_file_get(fd);
+    if (fid < 0) return 0;
+    acquire(&p->vmlock);
+    uint64_t start = p->mmap_top;
+    uint64_t end = start + PGROUNDUP(len);
+    struct vma *v = end > USTACK_BOTTOM ? 0 : vma_add(p, start, end, perm, VMA_FILE);
+    if (v) {
+        v->fid = fid;
+        v->off = 0;
+        p->mmap_top = end;
+    }
+    release(&p->vmlock);
+    if (v == 0) fs_file_put(fid);
+    return v ? start : 0;
+}
+
+/* 缺页处理（持有 p->vmlock）：堆/栈按需分配清零页，文件映射首次访问时装入文件内容，
+   写入写时复制页时复制。成功返回 0，非法访问返回 -1 */
+static int vm_fault_locked(struct proc *p, uint64_t va, int access) {
+    struct vma *v = vma_find(p, va);
+    if (v == 0) return -1;
+    int write = (access & FAULT_WRITE) != 0;
+    if (write && !(v->perm & PTE_W)) return -1;
+    /* 取指缺页：区域不可执行就不建立映射，否则重新执行仍会缺页 */
+    if ((access & FAULT_EXEC) && !(v->perm & PTE_X)) return -1;
+
+    uint64_t a = PGROUNDDOWN(va);
+    pte_t *pte = walk(p->pagetable, a, 0);
+    if (pte && (*pte & PTE_SWAP)) {
+        /* 已被压缩换出：解压回来，写时复制标记随 PTE 保留 */
+        if (swap_in(pte, a, proc_asid(p)) < 0) return -1;
+        p->nfault_swap++;
+        if (write && (*pte & PTE_COW)) return vm_fault_locked(p, va, access);
+        return 0;
+    }
+    if (pte && (*pte & PTE_V)) {
+        /* 已映射：只可能是写时复制 */
+        if (write && (*pte & PTE_COW) && cow_fault(p->pagetable, proc_asid(p), a) == 0) {
+            p->nfault_cow++;
+            return 0;
+        }
+        return -1;
+    }
+
+    void *mem;
+    if (v->type == VMA_FILE) {
+        mem = alloc_page_nozero();
+        if (mem == 0) return -1;
+        int n = fs_read_at(v->fid, v->off + (a - v->start), mem, PGSIZE);
+        if (n < 0) n = 0;
+        for (char *c = (char*)mem + n; c < (char*)mem + PGSIZE; c++) *c = 0;
+        p->nfault_file++;
+    } else {
+        mem = alloc_page();
+        if (mem == 0) return -1;
+        p->nfault_anon++;
+    }
+    if (uvm_map(p->pagetable, a, (uint64_t)mem, v->perm) != 0) {
+        free_page(mem);
+        return -1;
+    }
+    pmm_set_tag(mem, PMM_TAG_USER);
+    tlb_flush_page(a, proc_asid(p));
+    return 0;
+}
+
+int vm_fault(struct proc *p, uint64_t va, int access) {
+    acquire(&p->vmlock);
+    int r = vm_fault_locked(p, va, access);
+    release(&p->vmlock);
+    return r;
+}
+
+/* ====== 用户内存拷贝 ====== */
+
+/* 按 8 字节块拷贝：两边对齐方式相同时先补齐到 8 字节边界（非对齐的 8 字节访问在 M 态会陷入模拟） */
+static void copy_bulk(void *dst, const void *src, uint64_t n) {
+    char *d = (char*)dst;
+    const char *s = (const char*)src;
+    if ((((uint64_t)d ^ (uint64_t)s) & 7) == 0) {
+        while (n && ((uint64_t)d & 7)) {
+            *d++ = *s++;
+            n--;
+        }
+        for (; n >= 8; n -= 8, d += 8, s += 8) {
+            *(uint64_t*)d = *(const uint64_t*)s;
+        }
+    }
+    while (n--) *d++ = *s++;
+}
+
+/* 用户地址 va 对应的物理地址（持有 p->vmlock）。尚未装入、已换出或写时复制的页先按缺页处理，
+   非法地址返回 0 */
+static uint64_t user_pa(struct proc *p, uint64_t va, int write) {
+    int need = PTE_V | PTE_U | (write ? PTE_W : PTE_R);
+    for (int tries = 0; tries < 2; tries++) {
+        int level;
+        pte_t *pte = walk_leaf(p->pagetable, va, &level);
+        if (pte && (*pte & need) == need) {
+            return PTE2PA(*pte) + (va & (LEVEL_SIZE(level) - 1));
+        }
+        if (tries == 0 && vm_fault_locked(p, va, write ? FAULT_WRITE : 0) < 0) break;
+    }
+    return 0;
+}
+
+/* 过渡用的兼容路径：进程是内核线程，缓冲区常在自己的内核栈上，传入的字符串和常量在 .rodata 中。
+   内核地址只接受这两处：调用者自己的内核栈（可读写）和内核代码/只读数据（只读），
+   其余内核内存（页表、其他进程的栈、堆）一律 -EFAULT。返回 va 所在允许区域的末尾，不允许返回 0 */
+static uint64_t kernel_limit(struct proc *p, uint64_t va, int write) {
+    extern char erodata[];
+    if (p && va >= (uint64_t)p->kstack && va < (uint64_t)p->kstack + KSTACK_SIZE) {
+        return (uint64_t)p->kstack + KSTACK_SIZE;
+    }
+    if (!write && va >= KERNBASE && va < (uint64_t)erodata) return (uint64_t)erodata;
+    return 0;
+}
+
+int kernel_buf_ok(struct proc *p, uint64_t va, uint64_t len, int write) {
+    if (va + len < va) return 0;
+    return va + len <= kernel_limit(p, va, write);
+}
+
+/* 内核地址按 kernel_buf_ok 检查后直接拷贝；用户地址每页查一次页表，
+   拷贝期间持有 vmlock，页面不会被换出。out 为 1 时 kbuf -> uva，否则 uva -> kbuf */
+static int copy_user(struct proc *p, uint64_t uva, void *kbuf, uint64_t len, int out) {
+    if (len == 0) return 0;
+    if (uva + len < uva) return -EFAULT;
+    if (uva >= KERNBASE) {
+        if (!kernel_buf_ok(p, uva, len, out)) return -EFAULT;
+        if (out) copy_bulk((void*)uva, kbuf, len);
+        else copy_bulk(kbuf, (const void*)uva, len);
+        return 0;
+    }
+    if (p == 0 || uva < USERBASE || uva + len > USERTOP) return -EFAULT;
+
+    char *k = (char*)kbuf;
+    acquire(&p->vmlock);
+    while (len > 0) {
+        uint64_t pa = user_pa(p, uva, out);
+        if (pa == 0) {
+            release(&p->vmlock);
+            return -EFAULT;
+        }
+        uint64_t n = PGSIZE - (uva & (PGSIZE - 1));
+        if (n > len) n = len;
+        if (out) copy_bulk((void*)pa, k, n);
+        else copy_bulk(k, (const void*)pa, n);
+        uva += n;
+        k += n;
+        len -= n;
+    }
+    release(&p->vmlock);
+    return 0;
+}
+
+int copyin(struct proc *p, void *dst, uint64_t srcva, uint64_t len) {
+    return copy_user(p, srcva, dst, len, 0);
+}
+
+int copyout(struct proc *p, uint64_t dstva, const void *src, uint64_t len) {
+    return copy_user(p, dstva, (void*)src, len, 1);
+}
+
+/* 拷贝以 0 结尾的字符串，返回长度（不含结尾 0）；max 字节内没有结尾返回 -ENAMETOOLONG */
+int copyinstr(struct proc *p, char *dst, uint64_t srcva, uint64_t max) {
+    if (max == 0) return -ENAMETOOLONG;
+    if (srcva >= KERNBASE) {
+        uint64_t limit = kernel_limit(p, srcva, 0);
+        const char *s = (const char*)srcva;
+        for (uint64_t i = 0; i < max; i++) {
+            if (srcva + i >= limit) return -EFAULT;
+            dst[i] = s[i];
+            if (s[i] == 0) return i;
+        }
+        return -ENAMETOOLONG;
+    }
+    if (p == 0 || srcva < USERBASE || srcva >= USERTOP) return -EFAULT;
+
+    uint64_t i = 0;
+    acquire(&p->vmlock);
+    while (i < max) {
+        uint64_t va = srcva + i;
+        uint64_t pa = va < USERTOP ? user_pa(p, va, 0) : 0;
+        if (pa == 0) {
+            release(&p->vmlock);
+            return -EFAULT;
+        }
+        const char *s = (const char*)pa;
+        uint64_t n = PGSIZE - (va & (PGSIZE - 1));
+        for (uint64_t j = 0; j < n && i < max; j++, i++) {
+            dst[i] = s[j];
+            if (s[j] == 0) {
+                release(&p->vmlock);
+                return i;
+            }
+        }
+    }
+    release(&p->vmlock);
+    return -ENAMETOOLONG;
+}
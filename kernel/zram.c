@@ -0,0 +1,286 @@
+#include "riscv.h"
+#include "memlayout.h"
+#include "printf.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "zram.h"
+
+/* 压缩后最多保存的字节数：超过则视为不可压缩，不换出 */
+#define ZRAM_MAX_STORE (ZRAM_MAX_CHUNKS * KMALLOC_MAX_CACHE_SIZE)
+
+/* 一个换出页：压缩数据分块存放；len 为 0 表示整页由同一个 64 位值填充 */
+struct zslot {
+    void *chunk[ZRAM_MAX_CHUNKS];
+    uint16_t len;
+    uint8_t used;
+    uint64_t fill;
+};
+
+/* 保护 slot 表、统计以及共用的暂存区/哈希表 */
+static struct spinlock zram_lock = SPINLOCK_INIT("zram");
+
+static struct zslot slots[ZRAM_NSLOTS];
+static int next_free = 0;   /* 空闲 slot 搜索起点 */
+
+static struct {
+    uint64_t stored;        /* 当前换出的页数 */
+    uint64_t same_filled;   /* 其中同值填充页数（不占压缩空间） */
+    uint64_t compr_bytes;   /* 当前压缩数据总字节数 */
+    uint64_t swapouts;
+    uint64_t swapins;
+    uint64_t rejected;      /* 不可压缩或无空间而放弃的页 */
+    uint64_t lat_total;     /* 换入（解压）耗时，mtime 计数 */
+    uint64_t lat_max;
+} zs;
+
+/* 压缩/解压共用的暂存区 */
+static uint8_t zbuf[ZRAM_MAX_STORE];
+
+/* ====== LZ 编解码 ======
+   格式与 LZ4 块格式类似：每段一个 token（高 4 位字面量长度，低 4 位匹配长度-4，
+   15 表示后续有扩展字节，每字节 255 表示继续），然后是字面量、2 字节小端偏移和匹配长度扩展。
+   最后一段只有字面量。 */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static uint16_t lz_hash[1 << LZ_HASH_BITS];   /* 位置 + 1，0 表示空 */
+
+static inline uint32_t load32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t lz_hashof(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static int lz_put_len(uint8_t *out, int op, int max, int len) {
+    while (len >= 255) {
+        if (op >= max) return -1;
+        out[op++] = 255;
+        len -= 255;
+    }
+    if (op >= max) return -1;
+    out[op++] = len;
+    return op;
+}
+
+/* 输出一段：nlit 个字面量，mlen 为 0 表示最后一段（没有匹配） */
+static int lz_emit(uint8_t *out, int op, int max, const uint8_t *lit, int nlit, int off, int mlen) {
+    int ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+    if (op >= max) return -1;
+    out[op++] = ((nlit < 15 ? nlit : 15) << 4) | (ml < 15 ? ml : 15);
+    if (nlit >= 15 && (op = lz_put_len(out, op, max, nlit - 15)) < 0) return -1;
+    if (op + nlit > max) return -1;
+    for (int i = 0; i < nlit; i++) out[op++] = lit[i];
+    if (mlen == 0) return op;
+    if (op + 2 > max) return -1;
+    out[op++] = off & 0xFF;
+    out[op++] = off >> 8;
+    if (ml >= 15 && (op = lz_put_len(out, op, max, ml - 15)) < 0) return -1;
+    return op;
+}
+
+/* 压缩 n 字节，返回压缩后长度；输出超过 max 返回 -1 */
+static int lz_compress(const uint8_t *in, int n, uint8_t *out, int max) {
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) lz_hash[i] = 0;
+
+    int ip = 0, anchor = 0, op = 0;
+    while (ip + LZ_MIN_MATCH <= n) {
+        uint32_t v = load32(in + ip);
+        uint32_t h = lz_hashof(v);
+        int ref = lz_hash[h] - 1;
+        lz_hash[h] = ip + 1;
+        if (ref < 0 || load32(in + ref) != v) {
+            ip++;
+            continue;
+        }
+        int mlen = LZ_MIN_MATCH;
+        while (ip + mlen < n && in[ref + mlen] == in[ip + mlen]) mlen++;
+        op = lz_emit(out, op, max, in + anchor, ip - anchor, ip - ref, mlen);
+        if (op < 0) return -1;
+        ip += mlen;
+        anchor = ip;
+    }
+    return lz_emit(out, op, max, in + anchor, n - anchor, 0, 0);
+}
+
+/* 解压，返回输出长度；数据损坏返回 -1 */
+static int lz_decompress(const uint8_t *in, int n, uint8_t *out, int max) {
+    int ip = 0, op = 0;
+    while (ip < n) {
+        int tok = in[ip++];
+        int nlit = tok >> 4;
+        if (nlit == 15) {
+            int b;
+            do {
+                if (ip >= n) return -1;
+                b = in[ip++];
+                nlit += b;
+            } while (b == 255);
+        }
+        if (ip + nlit > n || op + nlit > max) return -1;
+        for (int i = 0; i < nlit; i++) out[op++] = in[ip++];
+        if (ip == n) break;   /* 最后一段 */
+
+        if (ip + 2 > n) return -1;
+        int off = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        int mlen = tok & 15;
+        if (mlen == 15) {
+            int b;
+            do {
+                if (ip >= n) return -1;
+                b = in[ip++];
+                mlen += b;
+            } while (b == 255);
+        }
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > op || op + mlen > max) return -1;
+        for (int i = 0; i < mlen; i++, op++) out[op] = out[op - off];
+    }
+    return op;
+}
+
+/* ====== slot 管理 ====== */
+
+static int slot_alloc(void) {
+    for (int i = 0; i < ZRAM_NSLOTS; i++) {
+        int s = (next_free + i) % ZRAM_NSLOTS;
+        if (!slots[s].used) {
+            next_free = (s + 1) % ZRAM_NSLOTS;
+            slots[s].used = 1;
+            return s;
+        }
+    }
+    return -1;
+}
+
+static void slot_release(struct zslot *z) {
+    for (int i = 0; i < ZRAM_MAX_CHUNKS; i++) {
+        if (z->chunk[i]) kfree(z->chunk[i]);
+        z->chunk[i] = 0;
+    }
+    z->len = 0;
+    z->used = 0;
+}
+
+/* 整页是否由同一个 64 位值填充（最常见的是全零页） */
+static int page_same_filled(const void *page, uint64_t *val) {
+    const uint64_t *w = (const uint64_t*)page;
+    for (int i = 1; i < PGSIZE / sizeof(uint64_t); i++) {
+        if (w[i] != w[0]) return 0;
+    }
+    *val = w[0];
+    return 1;
+}
+
+static int zram_store_locked(const void *page) {
+    int s = slot_alloc();
+    if (s < 0) {
+        zs.rejected++;
+        return -1;
+    }
+    struct zslot *z = &slots[s];
+
+    uint64_t fill;
+    if (page_same_filled(page, &fill)) {
+        z->fill = fill;
+        z->len = 0;
+        zs.same_filled++;
+    } else {
+        int len = lz_compress((const uint8_t*)page, PGSIZE, zbuf, ZRAM_MAX_STORE);
+        if (len <= 0) {
+            z->used = 0;
+            zs.rejected++;
+            return -1;
+        }
+        /* 按 1KB 分块，尾块只占相应大小的 kmalloc 对象 */
+        for (int off = 0, i = 0; off < len; off += KMALLOC_MAX_CACHE_SIZE, i++) {
+            int n = len - off < KMALLOC_MAX_CACHE_SIZE ? len - off : KMALLOC_MAX_CACHE_SIZE;
+            uint8_t *c = (uint8_t*)kmalloc(n);
+            if (c == 0) {
+                slot_release(z);
+                zs.rejected++;
+                return -1;
+            }
+            for (int j = 0; j < n; j++) c[j] = zbuf[off + j];
+            z->chunk[i] = c;
+        }
+        z->len = len;
+        zs.compr_bytes += len;
+    }
+    zs.stored++;
+    zs.swapouts++;
+    return s;
+}
+
+int zram_store(const void *page) {
+    acquire(&zram_lock);
+    int s = zram_store_locked(page);
+    release(&zram_lock);
+    return s;
+}
+
+static int zram_load_locked(int slot, void *page) {
+    if (slot < 0 || slot >= ZRAM_NSLOTS || !slots[slot].used) return -1;
+    struct zslot *z = &slots[slot];
+    uint64_t t0 = clint_read64(CLINT_MTIME);
+
+    if (z->len == 0) {
+        uint64_t *w = (uint64_t*)page;
+        for (int i = 0; i < PGSIZE / sizeof(uint64_t); i++) w[i] = z->fill;
+    } else {
+        for (int off = 0, i = 0; off < z->len; off += KMALLOC_MAX_CACHE_SIZE, i++) {
+            int n = z->len - off < KMALLOC_MAX_CACHE_SIZE ? z->len - off : KMALLOC_MAX_CACHE_SIZE;
+            const uint8_t *c = (const uint8_t*)z->chunk[i];
+            for (int j = 0; j < n; j++) zbuf[off + j] = c[j];
+        }
+        if (lz_decompress(zbuf, z->len, (uint8_t*)page, PGSIZE) != PGSIZE) {
+            printf("zram_load: slot %d corrupted\n", slot);
+            return -1;
+        }
+    }
+
+    uint64_t dt = clint_read64(CLINT_MTIME) - t0;
+    zs.lat_total += dt;
+    if (dt > zs.lat_max) zs.lat_max = dt;
+    zs.swapins++;
+    return 0;
+}
+
+int zram_load(int slot, void *page) {
+    acquire(&zram_lock);
+    int r = zram_load_locked(slot, page);
+    release(&zram_lock);
+    return r;
+}
+
+void zram_free(int slot) {
+    acquire(&zram_lock);
+    if (slot >= 0 && slot < ZRAM_NSLOTS && slots[slot].used) {
+        struct zslot *z = &slots[slot];
+        if (z->len == 0) zs.same_filled--;
+        zs.compr_bytes -= z->len;
+        zs.stored--;
+        slot_release(z);
+    }
+    release(&zram_lock);
+}
+
+void zram_dump(void) {
+    acquire(&zram_lock);
+    uint64_t orig = (zs.stored - zs.same_filled) * PGSIZE;
+    printf("zram: stored=%lu pages (same-filled %lu) compressed=%lu bytes",
+           (unsigned long)zs.stored, (unsigned long)zs.same_filled, (unsigned long)zs.compr_bytes);
+    if (zs.compr_bytes) {
+        printf(" ratio=%lu%%", (unsigned long)(orig * 100 / zs.compr_bytes));
+    }
+    printf("\n");
+    /* mtime 为 10MHz，1 个计数 = 0.1us */
+    printf("zram: swapouts=%lu swapins=%lu rejected=%lu fault avg=%luus max=%luus\n",
+           (unsigned long)zs.swapouts, (unsigned long)zs.swapins, (unsigned long)zs.rejected,
+           (unsigned long)(zs.swapins ? zs.lat_total / zs.swapins / 10 : 0),
+           (unsigned long)(zs.lat_max / 10));
+    release(&zram_lock);
+}